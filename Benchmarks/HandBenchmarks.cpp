@@ -0,0 +1,373 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+// Micro benchmarks of the per-frame hand processing, without a window or a Leap device.
+// Built by Benchmarks/CMakeLists.txt as a console application. HandSnapshot.h pulls in
+// the app's JuceHeader.h, so it links the same JUCE modules as the app; from the Leap SDK
+// only the headers are needed (LeapMath is header only, nothing needs the Leap library).
+//
+//   HandBenchmarks [--session recording.vhs] [--output results.json] [--samples n]
+//
+// Every kernel runs over synthetic frames with 1, 2 and 4 hands, and over the
+// recorded session if one is given. Results are written as JSON, to stdout by default.
+// Pose matching runs against a library of kNumLibraryPoses synthetic poses. The demo
+// physics runs with 1, 16 and ContactSolver::kMaxBodies blocks.
+
+#include "../HandSkeleton.h"
+#include "../ContactSolver.h"
+#include "../SessionFile.h"
+#include "../PoseLibrary.h"
+#include "../SyntheticHands.h"
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	const int kNumSyntheticFrames = 1000;
+	const int kMinSampleMilliseconds = 5;
+	const int kNumLibraryPoses = 10000;
+
+	const PoseLibrary* s_pPoseLibrary = nullptr;
+
+	//==============================================================================
+	// Keeps the compiler from optimising the measured work away.
+	struct Checksum
+	{
+		Checksum() : value(0) {}
+
+		void add(const Leap::Vector& v)  { value += v.x + v.y * 3.0 + v.z * 7.0; }
+
+		double value;
+	};
+
+	struct Result
+	{
+		String kernel;
+		String data;
+		int    numHands;      // average for recorded sessions, rounded
+		int    numBodies;
+		int    numPoses;
+		int    numFrames;
+		double nsPerFrameMedian;
+		double nsPerFrameMin;
+		double nsPerHand;
+	};
+
+	typedef void (*Kernel)(const Array<FrameSnapshot>& frames, int numBodies, Checksum& checksum);
+
+	//==============================================================================
+	// Leap millimetres to scene units for every palm, tip and direction.
+	void frameToScene(const Array<FrameSnapshot>& frames, int, Checksum& checksum)
+	{
+		const SceneTransform transform;
+
+		for (int i = 0; i < frames.size(); ++i)
+		{
+			const FrameSnapshot& frame = frames.getReference(i);
+
+			for (int handCount = 0; handCount < frame.numHands; ++handCount)
+			{
+				const HandSnapshot& hand = frame.hands[handCount];
+				checksum.add(transform.toScene(hand.palmPosition));
+
+				for (int fingerCount = 0; fingerCount < hand.numFingers; ++fingerCount)
+				{
+					checksum.add(transform.toScene(hand.fingers[fingerCount].tipPosition));
+					checksum.add(transform.frameTransform.transformDirection(hand.fingers[fingerCount].direction));
+				}
+			}
+		}
+	}
+
+	// The joint chains and the bone outline matrices drawn for them.
+	void jointChains(const Array<FrameSnapshot>& frames, int, Checksum& checksum)
+	{
+		const SceneTransform transform;
+		HandSkeleton skeleton;
+
+		for (int i = 0; i < frames.size(); ++i)
+		{
+			const FrameSnapshot& frame = frames.getReference(i);
+
+			for (int handCount = 0; handCount < frame.numHands; ++handCount)
+			{
+				buildHandSkeleton(frame.hands[handCount], transform, skeleton);
+				checksum.add(skeleton.palmTransform.origin);
+
+				for (int fingerCount = 0; fingerCount < skeleton.numFingers; ++fingerCount)
+				{
+					const FingerSkeleton& finger = skeleton.fingers[fingerCount];
+
+					for (int j = 0; j < finger.numJoints; ++j)
+					{
+						const Leap::Matrix outline = createTransform(finger.boneDirections[j], (finger.joints[j] + finger.joints[j+1]) / 2);
+						checksum.add(outline.xBasis);
+					}
+				}
+			}
+		}
+	}
+
+	// Blocks on a grid over the floor under the hands, the first one where the demo sphere rests.
+	Leap::Vector getBodyPosition(int index, int numBodies)
+	{
+		const int gridSize = jmax(1, (int) std::ceil(std::sqrt((double) numBodies)));
+		const float x = 0.1f + ((index % gridSize) - gridSize / 2) * 0.8f;
+		const float z = -0.6f + ((index / gridSize) - gridSize / 2) * 0.8f;
+
+		return Leap::Vector(x, -1.6f, z);
+	}
+
+	// The demo physics: skeletons and a contact solver update per frame, with blocks
+	// dropping onto the floor and pushed around by the hands.
+	void contactSolver(const Array<FrameSnapshot>& frames, int numBodies, Checksum& checksum)
+	{
+		const SceneTransform transform;
+		const float frameScale = transform.frameScale;
+		HandSkeleton skeletons[FrameSnapshot::kMaxHands];
+
+		ContactSolver solver;
+		solver.setFloor(-1.6f - 50 * frameScale);
+		solver.setGravity(9810.0f * frameScale);
+
+		for (int i = 0; i < numBodies; ++i)
+			solver.addBox(getBodyPosition(i, numBodies), Leap::Vector(0.12f, 0.12f, 0.12f));
+
+		for (int i = 0; i < frames.size(); ++i)
+		{
+			const FrameSnapshot& frame = frames.getReference(i);
+
+			for (int handCount = 0; handCount < frame.numHands; ++handCount)
+				buildHandSkeleton(frame.hands[handCount], transform, skeletons[handCount]);
+
+			solver.update(frame, skeletons, 5.0f * frameScale, Leap::Vector(18.75f, 5.0f, 18.75f) * frameScale);
+		}
+
+		checksum.add(solver.getBody(solver.getNumBodies() - 1).position);
+	}
+
+	// Feature extraction and the nearest poses in the library, for every hand.
+	void poseQuery(const Array<FrameSnapshot>& frames, int, Checksum& checksum)
+	{
+		float features[PoseFeatures::kNumFeatures];
+		PoseMatches matches;
+
+		for (int i = 0; i < frames.size(); ++i)
+		{
+			const FrameSnapshot& frame = frames.getReference(i);
+
+			for (int handCount = 0; handCount < frame.numHands; ++handCount)
+			{
+				PoseFeatures::extract(frame.hands[handCount], features);
+				s_pPoseLibrary->findNearest(features, matches);
+				checksum.value += matches.matches[0].index + matches.matches[0].distance;
+			}
+		}
+	}
+
+	// Poses of synthetic hands, from a different seed than the frames they are matched against.
+	bool writePoseLibrary(const File& file, int numPoses)
+	{
+		const Array<FrameSnapshot> frames(SyntheticHands::createFrames(1, numPoses, 4321));
+		PoseLibraryWriter writer;
+		float features[PoseFeatures::kNumFeatures];
+
+		for (int i = 0; i < frames.size(); ++i)
+		{
+			PoseFeatures::extract(frames.getReference(i).hands[0], features);
+			writer.addPose(String::formatted("pose %d", i), features);
+		}
+
+		return writer.writeTo(file);
+	}
+
+	//==============================================================================
+	double getAverageNumHands(const Array<FrameSnapshot>& frames)
+	{
+		int64 numHands = 0;
+
+		for (int i = 0; i < frames.size(); ++i)
+			numHands += frames.getReference(i).numHands;
+
+		return frames.size() > 0 ? numHands / (double) frames.size() : 0.0;
+	}
+
+	// Median and fastest time of numSamples runs over all frames. Each run repeats the
+	// frames often enough to take a few milliseconds, so timer resolution does not matter.
+	Result measure(const String& kernelName, Kernel kernel, const String& dataName, const Array<FrameSnapshot>& frames,
+		int numBodies, int numSamples, Checksum& checksum)
+	{
+		const double ticksPerNanosecond = Time::getHighResolutionTicksPerSecond() / 1.0e9;
+
+		// Warm up, and find how many passes fill a sample.
+		int numPasses = 1;
+
+		for (;;)
+		{
+			const int64 start = Time::getHighResolutionTicks();
+
+			for (int pass = 0; pass < numPasses; ++pass)
+				kernel(frames, numBodies, checksum);
+
+			const double elapsedMs = (Time::getHighResolutionTicks() - start) / ticksPerNanosecond / 1.0e6;
+
+			if (elapsedMs >= kMinSampleMilliseconds || numPasses >= (1 << 20))
+				break;
+
+			numPasses *= 2;
+		}
+
+		Array<double> samples;
+
+		for (int sample = 0; sample < numSamples; ++sample)
+		{
+			const int64 start = Time::getHighResolutionTicks();
+
+			for (int pass = 0; pass < numPasses; ++pass)
+				kernel(frames, numBodies, checksum);
+
+			const int64 elapsed = Time::getHighResolutionTicks() - start;
+			samples.add(elapsed / ticksPerNanosecond / ((double) numPasses * frames.size()));
+		}
+
+		std::sort(samples.begin(), samples.end());
+
+		const double averageNumHands = getAverageNumHands(frames);
+
+		Result result;
+		result.kernel = kernelName;
+		result.data = dataName;
+		result.numHands = roundToInt(averageNumHands);
+		result.numBodies = numBodies;
+		result.numPoses = 0;
+		result.numFrames = frames.size();
+		result.nsPerFrameMedian = samples[samples.size() / 2];
+		result.nsPerFrameMin = samples[0];
+		result.nsPerHand = averageNumHands > 0 ? result.nsPerFrameMedian / averageNumHands : 0.0;
+		return result;
+	}
+
+	void runKernels(const String& dataName, const Array<FrameSnapshot>& frames, int numSamples,
+		Array<Result>& results, Checksum& checksum)
+	{
+		const int bodyCounts[] = { 1, 16, ContactSolver::kMaxBodies };
+
+		results.add(measure("frameToScene", frameToScene, dataName, frames, 0, numSamples, checksum));
+		results.add(measure("jointChains", jointChains, dataName, frames, 0, numSamples, checksum));
+
+		for (int i = 0; i < numElementsInArray(bodyCounts); ++i)
+			results.add(measure("contactSolver", contactSolver, dataName, frames, bodyCounts[i], numSamples, checksum));
+
+		if (s_pPoseLibrary != nullptr)
+		{
+			Result result(measure("poseQuery", poseQuery, dataName, frames, 0, numSamples, checksum));
+			result.numPoses = s_pPoseLibrary->getNumPoses();
+			results.add(result);
+		}
+	}
+
+	String toJSON(const Array<Result>& results, int numSamples, const Checksum& checksum)
+	{
+		String json;
+		json << "{\n"
+			<< "  \"benchmark\": \"HandBenchmarks\",\n"
+			<< "  \"os\": \"" << SystemStats::getOperatingSystemName() << "\",\n"
+			<< "  \"cpu\": \"" << SystemStats::getCpuVendor() << "\",\n"
+			<< "  \"numCpus\": " << SystemStats::getNumCpus() << ",\n"
+			<< "  \"samples\": " << numSamples << ",\n"
+			<< "  \"checksum\": " << String(checksum.value, 3) << ",\n"
+			<< "  \"results\": [";
+
+		for (int i = 0; i < results.size(); ++i)
+		{
+			const Result& r = results.getReference(i);
+
+			json << (i > 0 ? ",\n" : "\n")
+				<< "    {\"kernel\": \"" << r.kernel << "\", \"data\": \"" << r.data << "\""
+				<< ", \"hands\": " << r.numHands << ", \"bodies\": " << r.numBodies << ", \"poses\": " << r.numPoses << ", \"frames\": " << r.numFrames
+				<< ", \"nsPerFrameMedian\": " << String(r.nsPerFrameMedian, 2)
+				<< ", \"nsPerFrameMin\": " << String(r.nsPerFrameMin, 2)
+				<< ", \"nsPerHand\": " << String(r.nsPerHand, 2) << "}";
+		}
+
+		json << "\n  ]\n}\n";
+		return json;
+	}
+
+	String getOptionValue(const StringArray& args, const String& option)
+	{
+		int index = args.indexOf(option);
+
+		return (index >= 0 && index + 1 < args.size()) ? args[index + 1].unquoted() : String::empty;
+	}
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+	StringArray args;
+
+	for (int i = 1; i < argc; ++i)
+		args.add(argv[i]);
+
+	const int numSamples = jmax(1, getOptionValue(args, "--samples").getIntValue() > 0
+		? getOptionValue(args, "--samples").getIntValue() : 15);
+
+	Array<Result> results;
+	Checksum checksum;
+
+	TemporaryFile poseLibraryFile(".vhpl");
+	ScopedPointer<PoseLibrary> poseLibrary;
+
+	if (writePoseLibrary(poseLibraryFile.getFile(), kNumLibraryPoses))
+		poseLibrary = new PoseLibrary(poseLibraryFile.getFile());
+
+	if (poseLibrary != nullptr && poseLibrary->isValid())
+		s_pPoseLibrary = poseLibrary;
+	else
+		std::cerr << "Could not write the pose library, skipping poseQuery" << std::endl;
+
+	for (int numHands = 1; numHands <= FrameSnapshot::kMaxHands; numHands *= 2)
+		runKernels("synthetic", SyntheticHands::createFrames(numHands, kNumSyntheticFrames, 1234), numSamples, results, checksum);
+
+	const String sessionPath(getOptionValue(args, "--session"));
+
+	if (sessionPath.isNotEmpty())
+	{
+		const File sessionFile(File::getCurrentWorkingDirectory().getChildFile(sessionPath));
+		SessionReader reader(sessionFile);
+
+		if (! reader.isValid())
+		{
+			std::cerr << "Could not read session " << sessionFile.getFullPathName() << std::endl;
+			return 1;
+		}
+
+		Array<FrameSnapshot> frames;
+		FrameSnapshot frame;
+
+		while (reader.readNext(frame))
+			frames.add(frame);
+
+		runKernels(sessionFile.getFileName(), frames, numSamples, results, checksum);
+	}
+
+	const String json(toJSON(results, numSamples, checksum));
+	const String outputPath(getOptionValue(args, "--output"));
+
+	if (outputPath.isEmpty())
+	{
+		std::cout << json;
+	}
+	else if (! File::getCurrentWorkingDirectory().getChildFile(outputPath).replaceWithText(json))
+	{
+		std::cerr << "Could not write " << outputPath << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,960 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_CONTACTSOLVER_H
+#define VIRTUALHANDS_CONTACTSOLVER_H
+
+#include "HandSkeleton.h"
+#include <algorithm>
+#include <cfloat>
+
+// Lengths in scene units, speeds in scene units a second.
+namespace ContactSolverSettings
+{
+	const float kMargin             = 0.01f;   // contacts this far apart are kept, so bodies slow down before they touch
+	const float kSlop               = 0.005f;  // overlap left alone, so resting contacts persist
+	const float kBaumgarte          = 0.2f;    // part of the overlap removed per step
+	const float kMaxCorrectionSpeed = 2.0f;
+	const float kMaxHandSpeed       = 25.0f;   // tracking glitches beyond it do not fling bodies
+}
+
+//==============================================================================
+// Rigid spheres and boxes the hands can push, grasp, lift and throw.
+//
+// The hands are kinematic: every finger bone of a HandSkeleton is a capsule and the
+// palm a box, moving with the tracked hand. Each step collects the contacts between
+// the bodies, the hands and the floor, then solves them with projected Gauss-Seidel.
+// The solve starts from the impulses the same contacts ended the previous step with,
+// so a fixed number of iterations is enough for grasps and stacks to settle.
+// Bodies, contacts, steps and iterations are all bounded, so an update costs about
+// the same however many bodies the hands hold.
+class ContactSolver
+{
+public:
+	enum
+	{
+		kMaxBodies      = 32,
+		kMaxColliders   = FrameSnapshot::kMaxHands * (HandSnapshot::kMaxFingers * FingerSkeleton::kMaxJoints + 1),
+		kMaxContacts    = 512,   // per step, any further ones are dropped
+		kIterations     = 10,
+		kStepsPerSecond = 120,
+		kMaxSteps       = 4      // per update, the rest of a longer gap is dropped
+	};
+
+	enum Shape
+	{
+		kShape_Sphere,
+		kShape_Box,
+		kShape_Capsule   // finger bones only
+	};
+
+	struct Body
+	{
+		Shape        shape;
+		float        radius;           // spheres, and the bounding sphere of boxes
+		Leap::Vector halfExtents;      // boxes
+		Leap::Vector position;
+		Leap::Matrix rotation;         // bases only, the origin stays zero
+		Leap::Vector velocity;
+		Leap::Vector angularVelocity;
+		float        inverseMass;
+		Leap::Vector inverseInertia;   // about the body axes
+	};
+
+	ContactSolver()
+		: m_fFloorY(0),
+		m_fGravity(0),
+		m_numBodies(0),
+		m_numColliders(0),
+		m_numPreviousColliders(0),
+		m_contacts((size_t) kMaxContacts),
+		m_numContacts(0),
+		m_cache((size_t) kMaxContacts),
+		m_numCached(0),
+		m_bHasTimestamp(false),
+		m_lastTimestamp(0)
+	{}
+
+	// The floor is the plane y = floorY, gravity pulls down along y.
+	void setFloor(float floorY)      { m_fFloorY = floorY; }
+	void setGravity(float gravity)   { m_fGravity = gravity; }
+
+	void clear()
+	{
+		m_numBodies = 0;
+		m_numContacts = 0;
+		m_numCached = 0;
+	}
+
+	// Both return the index of the new body, or -1 once kMaxBodies are in.
+	int addSphere(const Leap::Vector& position, float radius, float density = 1.0f)
+	{
+		Body* body = addBody(kShape_Sphere, position);
+
+		if (body == nullptr)
+			return -1;
+
+		const float mass = density * 4.18879f * radius * radius * radius;
+		const float inertia = 0.4f * mass * radius * radius;
+
+		body->radius = radius;
+		body->inverseMass = 1.0f / mass;
+		body->inverseInertia = Leap::Vector(1.0f / inertia, 1.0f / inertia, 1.0f / inertia);
+		return m_numBodies - 1;
+	}
+
+	int addBox(const Leap::Vector& position, const Leap::Vector& halfExtents, float yaw = 0, float density = 1.0f)
+	{
+		Body* body = addBody(kShape_Box, position);
+
+		if (body == nullptr)
+			return -1;
+
+		const float mass = density * 8.0f * halfExtents.x * halfExtents.y * halfExtents.z;
+		const Leap::Vector squared(halfExtents.x * halfExtents.x, halfExtents.y * halfExtents.y, halfExtents.z * halfExtents.z);
+
+		body->radius = halfExtents.magnitude();
+		body->halfExtents = halfExtents;
+		body->rotation = Leap::Matrix(Leap::Vector::yAxis(), yaw);
+		body->inverseMass = 1.0f / mass;
+		body->inverseInertia = Leap::Vector(3.0f / (mass * (squared.y + squared.z)),
+			3.0f / (mass * (squared.x + squared.z)), 3.0f / (mass * (squared.x + squared.y)));
+		return m_numBodies - 1;
+	}
+
+	int getNumBodies() const              { return m_numBodies; }
+	const Body& getBody(int index) const  { return m_bodies[index]; }
+	int getNumContacts() const            { return m_numContacts; }
+
+	// Where a box or unit diameter sphere is drawn to show the body.
+	Leap::Matrix getBodyTransform(int index) const
+	{
+		const Body& body = m_bodies[index];
+		const Leap::Vector size = body.shape == kShape_Box ? body.halfExtents * 2.0f
+			: Leap::Vector(body.radius, body.radius, body.radius) * 2.0f;
+
+		return Leap::Matrix(body.rotation.xBasis * size.x, body.rotation.yBasis * size.y, body.rotation.zBasis * size.z,
+			body.position);
+	}
+
+	//==============================================================================
+	// Moves the hands to the frame and steps the bodies over the time since the last
+	// frame. skeletons holds one skeleton per hand of the frame.
+	void update(const FrameSnapshot& frame, const HandSkeleton* skeletons, float fingerRadius,
+		const Leap::Vector& palmHalfExtents)
+	{
+		// Replays can jump back: keep the bodies, forget how the hands were moving.
+		const bool bContinues = m_bHasTimestamp && frame.timestamp >= m_lastTimestamp;
+		const float elapsed = bContinues ? static_cast<float>((frame.timestamp - m_lastTimestamp) / 1000000.0) : 0.0f;
+
+		m_bHasTimestamp = true;
+		m_lastTimestamp = frame.timestamp;
+
+		setHands(frame, skeletons, fingerRadius, palmHalfExtents, bContinues ? elapsed : 0.0f);
+
+		if (elapsed <= 0)
+			return;
+
+		const float stepTime = 1.0f / kStepsPerSecond;
+		const int numSteps = jlimit(1, (int) kMaxSteps, (int) std::ceil(elapsed / stepTime - 0.01f));
+		const float dt = jmin(elapsed / numSteps, stepTime);
+
+		for (int i = 0; i < numSteps; ++i)
+			step(dt);
+	}
+
+	// One step without moving the hands.
+	void step(float dt)
+	{
+		for (int i = 0; i < m_numBodies; ++i)
+		{
+			Body& body = m_bodies[i];
+			body.velocity.y -= m_fGravity * dt;
+
+			// A little drag, and rolling resistance so balls come to rest.
+			body.velocity *= 1.0f / (1.0f + 0.05f * dt);
+			body.angularVelocity *= 1.0f / (1.0f + 1.0f * dt);
+		}
+
+		findContacts();
+		prepareContacts(dt);
+
+		for (int iteration = 0; iteration < kIterations; ++iteration)
+			for (int i = 0; i < m_numContacts; ++i)
+				solveContact(m_contacts[i]);
+
+		for (int i = 0; i < m_numBodies; ++i)
+			integrate(m_bodies[i], dt);
+
+		cacheImpulses();
+	}
+
+private:
+	// The hands, shaped like the bones and palm drawHands draws.
+	struct Collider
+	{
+		Shape        shape;
+		uint32       key;            // the same for the same bone from frame to frame
+		Leap::Vector start, end;     // capsules
+		float        radius;         // capsules, and the bounding sphere of boxes
+		Leap::Matrix transform;      // boxes
+		Leap::Vector halfExtents;
+		Leap::Vector centre;
+		Leap::Vector velocity;
+		Leap::Vector angularVelocity;
+	};
+
+	// One constrained direction of a contact, with its Jacobian worked out once
+	// per step so an iteration is a few dot products.
+	struct ContactRow
+	{
+		Leap::Vector direction;
+		Leap::Vector angularA, angularB;   // r x direction
+		Leap::Vector turnA, turnB;         // the inverse inertia times those
+		float        speedB;               // of the hand along direction, when B is one
+		float        mass;
+		float        impulse;
+	};
+
+	struct Contact
+	{
+		int64        key;
+		int          bodyA;
+		int          bodyB;          // -1 for the floor and the hands
+		int          collider;       // -1 unless a hand
+		Leap::Vector rA, rB;
+		Leap::Vector pointVelocityB; // of the hand at the contact, when B is one
+		float        penetration;
+		float        friction;
+		float        targetVelocity;
+		ContactRow   rows[3];        // the normal (the way A is pushed), then two tangents
+	};
+
+	struct CachedImpulse
+	{
+		bool operator<(const CachedImpulse& other) const  { return key < other.key; }
+
+		int64 key;
+		float impulses[3];
+	};
+
+	Body* addBody(Shape shape, const Leap::Vector& position)
+	{
+		if (m_numBodies == kMaxBodies)
+			return nullptr;
+
+		Body& body = m_bodies[m_numBodies++];
+		body.shape = shape;
+		body.radius = 0;
+		body.halfExtents = Leap::Vector::zero();
+		body.position = position;
+		body.rotation = Leap::Matrix();
+		body.velocity = Leap::Vector::zero();
+		body.angularVelocity = Leap::Vector::zero();
+		return &body;
+	}
+
+	//==============================================================================
+	void setHands(const FrameSnapshot& frame, const HandSkeleton* skeletons, float fingerRadius,
+		const Leap::Vector& palmHalfExtents, float elapsed)
+	{
+		for (int i = 0; i < m_numColliders; ++i)
+			m_previousColliders[i] = m_colliders[i];
+
+		m_numPreviousColliders = m_numColliders;
+		m_numColliders = 0;
+
+		for (int handCount = 0; handCount < frame.numHands; ++handCount)
+		{
+			const HandSnapshot& hand = frame.hands[handCount];
+			const HandSkeleton& skeleton = skeletons[handCount];
+			const uint32 handKey = (uint32) hand.id * 2654435761u;
+
+			for (int fingerCount = 0; fingerCount < skeleton.numFingers; ++fingerCount)
+			{
+				const FingerSkeleton& finger = skeleton.fingers[fingerCount];
+				const uint32 fingerKey = handKey ^ ((uint32) (hand.fingers[fingerCount].id + 1) * 40503u);
+
+				for (int i = 0; i < finger.numJoints; ++i)
+				{
+					Collider& collider = m_colliders[m_numColliders++];
+					collider.shape = kShape_Capsule;
+					collider.key = fingerKey ^ ((uint32) (i + 1) << 28);
+					collider.start = finger.joints[i];
+					collider.end = finger.joints[i + 1];
+					collider.radius = fingerRadius;
+					collider.centre = (collider.start + collider.end) / 2;
+				}
+			}
+
+			Collider& palm = m_colliders[m_numColliders++];
+			palm.shape = kShape_Box;
+			palm.key = handKey;
+			palm.transform = skeleton.palmTransform;
+			palm.halfExtents = palmHalfExtents;
+			palm.radius = palmHalfExtents.magnitude();
+			palm.centre = skeleton.palmTransform.origin;
+		}
+
+		// Velocities from how far each bone moved since the previous frame.
+		for (int i = 0; i < m_numColliders; ++i)
+		{
+			Collider& collider = m_colliders[i];
+			collider.velocity = Leap::Vector::zero();
+			collider.angularVelocity = Leap::Vector::zero();
+
+			if (elapsed <= 0)
+				continue;
+
+			for (int j = 0; j < m_numPreviousColliders; ++j)
+			{
+				const Collider& previous = m_previousColliders[j];
+
+				if (previous.key != collider.key)
+					continue;
+
+				collider.velocity = clampSpeed((collider.centre - previous.centre) / elapsed);
+
+				// Small angle rotations between the frames, good enough at tracking rates.
+				if (collider.shape == kShape_Capsule)
+				{
+					collider.angularVelocity = clampSpeed((previous.end - previous.start).normalized()
+						.cross((collider.end - collider.start).normalized()) / elapsed);
+				}
+				else
+				{
+					collider.angularVelocity = clampSpeed((previous.transform.xBasis.cross(collider.transform.xBasis)
+						+ previous.transform.yBasis.cross(collider.transform.yBasis)
+						+ previous.transform.zBasis.cross(collider.transform.zBasis)) / (2.0f * elapsed));
+				}
+
+				break;
+			}
+		}
+	}
+
+	static Leap::Vector clampSpeed(const Leap::Vector& velocity)
+	{
+		const float speed = velocity.magnitude();
+
+		return speed > ContactSolverSettings::kMaxHandSpeed ? velocity * (ContactSolverSettings::kMaxHandSpeed / speed) : velocity;
+	}
+
+	//==============================================================================
+	void findContacts()
+	{
+		m_numContacts = 0;
+
+		for (int a = 0; a < m_numBodies; ++a)
+		{
+			const Body& body = m_bodies[a];
+
+			if (body.position.y - body.radius < m_fFloorY + ContactSolverSettings::kMargin)
+				collideFloor(a);
+
+			for (int b = a + 1; b < m_numBodies; ++b)
+			{
+				const Body& other = m_bodies[b];
+				const float reach = body.radius + other.radius + ContactSolverSettings::kMargin;
+
+				if (body.position.distanceTo(other.position) < reach)
+					collideBodies(a, b);
+			}
+
+			for (int i = 0; i < m_numColliders; ++i)
+			{
+				const Collider& collider = m_colliders[i];
+				const float reach = body.radius + collider.radius + ContactSolverSettings::kMargin
+					+ (collider.shape == kShape_Capsule ? collider.start.distanceTo(collider.end) / 2 : 0.0f);
+
+				if (body.position.distanceTo(collider.centre) < reach)
+					collideHand(a, i);
+			}
+		}
+	}
+
+	void collideFloor(int a)
+	{
+		const Body& body = m_bodies[a];
+		const Leap::Vector up(Leap::Vector::yAxis());
+
+		if (body.shape == kShape_Sphere)
+		{
+			const Leap::Vector point(body.position.x, m_fFloorY, body.position.z);
+			addContact(a, -1, -1, ~0u, 0, point, up, m_fFloorY - (body.position.y - body.radius));
+			return;
+		}
+
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			const Leap::Vector point(getCorner(body.position, body.rotation, body.halfExtents, corner));
+
+			if (point.y < m_fFloorY + ContactSolverSettings::kMargin)
+				addContact(a, -1, -1, ~0u, corner, point, up, m_fFloorY - point.y);
+		}
+	}
+
+	void collideBodies(int a, int b)
+	{
+		const Body& bodyA = m_bodies[a];
+		const Body& bodyB = m_bodies[b];
+
+		if (bodyA.shape == kShape_Sphere && bodyB.shape == kShape_Sphere)
+		{
+			const Leap::Vector offset(bodyA.position - bodyB.position);
+			const float distance = offset.magnitude();
+			const Leap::Vector normal(distance > 1e-6f ? offset / distance : Leap::Vector::yAxis());
+
+			addContact(a, b, -1, (uint32) b, 0, bodyB.position + normal * bodyB.radius, normal,
+				bodyA.radius + bodyB.radius - distance);
+		}
+		else if (bodyA.shape == kShape_Sphere)
+		{
+			collideSphereBox(a, b, -1, (uint32) b, bodyA.position, bodyA.radius, bodyB.position, bodyB.rotation, bodyB.halfExtents, false);
+		}
+		else if (bodyB.shape == kShape_Sphere)
+		{
+			collideSphereBox(a, b, -1, (uint32) b, bodyB.position, bodyB.radius, bodyA.position, bodyA.rotation, bodyA.halfExtents, true);
+		}
+		else
+		{
+			collideBoxes(a, b, -1, (uint32) b, bodyA, bodyB.position, bodyB.rotation, bodyB.halfExtents);
+		}
+	}
+
+	void collideHand(int a, int colliderIndex)
+	{
+		const Body& body = m_bodies[a];
+		const Collider& collider = m_colliders[colliderIndex];
+		const uint32 key = collider.key | 0x80000000u;
+
+		if (collider.shape == kShape_Box)
+		{
+			if (body.shape == kShape_Sphere)
+				collideSphereBox(a, -1, colliderIndex, key, body.position, body.radius, collider.transform.origin,
+					collider.transform, collider.halfExtents, false);
+			else
+				collideBoxes(a, -1, colliderIndex, key, body, collider.transform.origin, collider.transform, collider.halfExtents);
+
+			return;
+		}
+
+		if (body.shape == kShape_Sphere)
+		{
+			const Leap::Vector onBone(closestOnSegment(collider.start, collider.end, body.position));
+			const Leap::Vector offset(body.position - onBone);
+			const float distance = offset.magnitude();
+			const Leap::Vector normal(distance > 1e-6f ? offset / distance : Leap::Vector::yAxis());
+
+			addContact(a, -1, colliderIndex, key, 0, onBone + normal * collider.radius, normal,
+				body.radius + collider.radius - distance);
+			return;
+		}
+
+		// Closest points of the bone and the box, by projecting back and forth.
+		Leap::Vector onBone(closestOnSegment(collider.start, collider.end, body.position));
+
+		for (int i = 0; i < 3; ++i)
+			onBone = closestOnSegment(collider.start, collider.end,
+				toWorld(body.position, body.rotation, clampToBox(toLocal(body.position, body.rotation, onBone), body.halfExtents)));
+
+		const Leap::Vector local(toLocal(body.position, body.rotation, onBone));
+		const Leap::Vector clamped(clampToBox(local, body.halfExtents));
+
+		if (local == clamped)
+		{
+			// The bone is inside: push the box off it through the nearest face.
+			float depth;
+			const Leap::Vector faceNormal(getNearestFace(body.rotation, body.halfExtents, local, depth));
+			addContact(a, -1, colliderIndex, key, 0, onBone, -faceNormal, collider.radius + depth);
+			return;
+		}
+
+		const Leap::Vector onBox(toWorld(body.position, body.rotation, clamped));
+		const Leap::Vector offset(onBox - onBone);
+		const float distance = offset.magnitude();
+
+		addContact(a, -1, colliderIndex, key, 0, onBox, offset / distance, collider.radius - distance);
+	}
+
+	// A sphere against a box. With bBoxIsA the box is the body that gets pushed.
+	void collideSphereBox(int a, int b, int colliderIndex, uint32 otherKey, const Leap::Vector& centre, float radius,
+		const Leap::Vector& boxPosition, const Leap::Matrix& boxRotation, const Leap::Vector& halfExtents, bool bBoxIsA)
+	{
+		const Leap::Vector local(toLocal(boxPosition, boxRotation, centre));
+		const Leap::Vector clamped(clampToBox(local, halfExtents));
+		Leap::Vector normal, point;
+		float penetration;
+
+		if (local == clamped)
+		{
+			float depth;
+			normal = getNearestFace(boxRotation, halfExtents, local, depth);
+			penetration = radius + depth;
+			point = centre - normal * radius;
+		}
+		else
+		{
+			point = toWorld(boxPosition, boxRotation, clamped);
+			const Leap::Vector offset(centre - point);
+			const float distance = offset.magnitude();
+
+			normal = offset / distance;
+			penetration = radius - distance;
+		}
+
+		if (penetration > -ContactSolverSettings::kMargin)
+			addContact(a, b, colliderIndex, otherKey, 0, point, bBoxIsA ? -normal : normal, penetration);
+	}
+
+	// Separating axis test over the face normals of both boxes and the cross products of
+	// their edges. Along a face normal the face of the other box most facing it is clipped
+	// to the reference face, which gives up to eight points for boxes resting on each other.
+	// Along an edge pair the contact is the closest point of the two edges.
+	void collideBoxes(int a, int b, int colliderIndex, uint32 otherKey, const Body& boxA,
+		const Leap::Vector& positionB, const Leap::Matrix& rotationB, const Leap::Vector& halfExtentsB)
+	{
+		const Leap::Vector axesA[3] = { boxA.rotation.xBasis, boxA.rotation.yBasis, boxA.rotation.zBasis };
+		const Leap::Vector axesB[3] = { rotationB.xBasis, rotationB.yBasis, rotationB.zBasis };
+		const float extentsA[3] = { boxA.halfExtents.x, boxA.halfExtents.y, boxA.halfExtents.z };
+		const float extentsB[3] = { halfExtentsB.x, halfExtentsB.y, halfExtentsB.z };
+		const Leap::Vector offset(positionB - boxA.position);
+
+		// Axes 0-2 are the faces of A, 3-5 the faces of B, 6-14 the edge pairs.
+		float bestSeparation = -FLT_MAX;
+		int bestAxis = -1;
+		Leap::Vector bestNormal;
+
+		for (int axis = 0; axis < 15; ++axis)
+		{
+			Leap::Vector direction;
+
+			if (axis < 3)
+				direction = axesA[axis];
+			else if (axis < 6)
+				direction = axesB[axis - 3];
+			else
+			{
+				direction = axesA[(axis - 6) / 3].cross(axesB[(axis - 6) % 3]);
+
+				// Parallel edges, the face axes cover them.
+				if (direction.magnitude() < 1e-3f)
+					continue;
+
+				direction = direction.normalized();
+			}
+
+			float reach = 0;
+
+			for (int i = 0; i < 3; ++i)
+				reach += extentsA[i] * std::abs(axesA[i].dot(direction)) + extentsB[i] * std::abs(axesB[i].dot(direction));
+
+			const float distance = offset.dot(direction);
+			const float separation = std::abs(distance) - reach;
+
+			if (separation > ContactSolverSettings::kMargin)
+				return;
+
+			// Faces win close calls, they give the steadier contacts.
+			const float bias = axis < 6 ? 0.0f : 1e-3f;
+
+			if (separation > bestSeparation + bias)
+			{
+				bestSeparation = separation;
+				bestAxis = axis;
+				bestNormal = distance < 0 ? -direction : direction;   // from A towards B
+			}
+		}
+
+		if (bestAxis < 6)
+		{
+			// Clip the face of the incident box to the reference face.
+			const bool bReferenceIsA = bestAxis < 3;
+			const int referenceAxis = bReferenceIsA ? bestAxis : bestAxis - 3;
+			const Leap::Vector& referencePosition = bReferenceIsA ? boxA.position : positionB;
+			const Leap::Vector* referenceAxes = bReferenceIsA ? axesA : axesB;
+			const float* referenceExtents = bReferenceIsA ? extentsA : extentsB;
+			const Leap::Vector* incidentAxes = bReferenceIsA ? axesB : axesA;
+			const float* incidentExtents = bReferenceIsA ? extentsB : extentsA;
+			const Leap::Vector& incidentPosition = bReferenceIsA ? positionB : boxA.position;
+
+			// Outward normal of the reference face, towards the incident box.
+			const Leap::Vector faceNormal(bReferenceIsA ? bestNormal : -bestNormal);
+
+			Leap::Vector polygon[8];
+			int numPoints = getIncidentFace(incidentPosition, incidentAxes, incidentExtents, faceNormal, polygon);
+
+			for (int i = 1; i <= 2 && numPoints > 0; ++i)
+			{
+				const Leap::Vector& side = referenceAxes[(referenceAxis + i) % 3];
+				const float extent = referenceExtents[(referenceAxis + i) % 3];
+				const float centre = side.dot(referencePosition);
+
+				numPoints = clipPolygon(polygon, numPoints, side, centre + extent);
+				numPoints = clipPolygon(polygon, numPoints, -side, extent - centre);
+			}
+
+			const float facePlane = faceNormal.dot(referencePosition) + referenceExtents[referenceAxis];
+
+			for (int i = 0; i < numPoints; ++i)
+			{
+				const float separation = faceNormal.dot(polygon[i]) - facePlane;
+
+				// A is pushed against bestNormal, out of B.
+				addContact(a, b, colliderIndex, otherKey, bestAxis * 8 + i, polygon[i], -bestNormal, -separation);
+			}
+
+			return;
+		}
+
+		// Edge against edge: the edge of each box nearest the other one.
+		const int edgeA = (bestAxis - 6) / 3;
+		const int edgeB = (bestAxis - 6) % 3;
+		Leap::Vector pointA(boxA.position), pointB(positionB);
+
+		for (int i = 0; i < 3; ++i)
+		{
+			if (i != edgeA)
+				pointA += axesA[i] * (axesA[i].dot(bestNormal) > 0 ? extentsA[i] : -extentsA[i]);
+
+			if (i != edgeB)
+				pointB += axesB[i] * (axesB[i].dot(bestNormal) < 0 ? extentsB[i] : -extentsB[i]);
+		}
+
+		const Leap::Vector onA(closestOnSegment(pointA - axesA[edgeA] * extentsA[edgeA], pointA + axesA[edgeA] * extentsA[edgeA],
+			closestOnSegment(pointB - axesB[edgeB] * extentsB[edgeB], pointB + axesB[edgeB] * extentsB[edgeB], pointA)));
+		const Leap::Vector onB(closestOnSegment(pointB - axesB[edgeB] * extentsB[edgeB], pointB + axesB[edgeB] * extentsB[edgeB], onA));
+
+		addContact(a, b, colliderIndex, otherKey, 48 + bestAxis, (onA + onB) / 2, -bestNormal, -bestSeparation);
+	}
+
+	// The four corners of the face of a box that faces most against the normal.
+	static int getIncidentFace(const Leap::Vector& position, const Leap::Vector* axes, const float* extents,
+		const Leap::Vector& normal, Leap::Vector* corners)
+	{
+		int axis = 0;
+		float best = 0;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			const float alignment = axes[i].dot(normal);
+
+			if (std::abs(alignment) > std::abs(best))
+			{
+				best = alignment;
+				axis = i;
+			}
+		}
+
+		const Leap::Vector centre(position + axes[axis] * (best > 0 ? -extents[axis] : extents[axis]));
+		const Leap::Vector u(axes[(axis + 1) % 3] * extents[(axis + 1) % 3]);
+		const Leap::Vector v(axes[(axis + 2) % 3] * extents[(axis + 2) % 3]);
+
+		corners[0] = centre - u - v;
+		corners[1] = centre + u - v;
+		corners[2] = centre + u + v;
+		corners[3] = centre - u + v;
+		return 4;
+	}
+
+	// Keeps the part of a convex polygon where direction . p <= limit. Room for eight points.
+	static int clipPolygon(Leap::Vector* points, int numPoints, const Leap::Vector& direction, float limit)
+	{
+		Leap::Vector clipped[8];
+		int numClipped = 0;
+
+		for (int i = 0; i < numPoints && numClipped < 7; ++i)
+		{
+			const Leap::Vector& current = points[i];
+			const Leap::Vector& next = points[(i + 1) % numPoints];
+			const float currentDistance = direction.dot(current) - limit;
+			const float nextDistance = direction.dot(next) - limit;
+
+			if (currentDistance <= 0)
+				clipped[numClipped++] = current;
+
+			if ((currentDistance < 0) != (nextDistance < 0) && currentDistance != nextDistance)
+				clipped[numClipped++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+		}
+
+		for (int i = 0; i < numClipped; ++i)
+			points[i] = clipped[i];
+
+		return numClipped;
+	}
+
+	void addContact(int a, int b, int colliderIndex, uint32 otherKey, int feature, const Leap::Vector& point,
+		const Leap::Vector& normal, float penetration)
+	{
+		if (penetration <= -ContactSolverSettings::kMargin || m_numContacts == kMaxContacts)
+			return;
+
+		Contact& contact = m_contacts[m_numContacts++];
+		contact.key = ((int64) a << 48) | ((int64) otherKey << 8) | feature;
+		contact.bodyA = a;
+		contact.bodyB = b;
+		contact.collider = colliderIndex;
+		contact.rows[0].direction = normal;
+		contact.penetration = penetration;
+		contact.rA = point - m_bodies[a].position;
+		contact.rB = b >= 0 ? point - m_bodies[b].position : Leap::Vector::zero();
+		contact.friction = colliderIndex >= 0 ? 1.2f : (b >= 0 ? 0.5f : 0.7f);
+
+		if (colliderIndex >= 0)
+		{
+			const Collider& collider = m_colliders[colliderIndex];
+			contact.pointVelocityB = collider.velocity + collider.angularVelocity.cross(point - collider.centre);
+		}
+		else
+		{
+			contact.pointVelocityB = Leap::Vector::zero();
+		}
+	}
+
+	//==============================================================================
+	void prepareContacts(float dt)
+	{
+		for (int i = 0; i < m_numContacts; ++i)
+		{
+			Contact& contact = m_contacts[i];
+			const Leap::Vector n = contact.rows[0].direction;
+
+			// Any fixed pair of tangents, so cached friction impulses still line up.
+			contact.rows[1].direction = (std::abs(n.x) > 0.57f ? Leap::Vector(n.y, -n.x, 0) : Leap::Vector(0, n.z, -n.y)).normalized();
+			contact.rows[2].direction = n.cross(contact.rows[1].direction);
+
+			// Separating speed that removes part of the overlap this step; a gap allows
+			// closing at up to the speed that just closes it.
+			if (contact.penetration > ContactSolverSettings::kSlop)
+			{
+				contact.targetVelocity = jmin(ContactSolverSettings::kBaumgarte * (contact.penetration - ContactSolverSettings::kSlop) / dt,
+					ContactSolverSettings::kMaxCorrectionSpeed);
+			}
+			else
+			{
+				contact.targetVelocity = jmin(contact.penetration, 0.0f) / dt;
+			}
+
+			const CachedImpulse* cached = findCached(contact.key);
+
+			for (int j = 0; j < 3; ++j)
+			{
+				prepareRow(contact, contact.rows[j]);
+
+				if (cached != nullptr)
+				{
+					contact.rows[j].impulse = cached->impulses[j];
+					applyImpulse(contact, contact.rows[j], cached->impulses[j]);
+				}
+			}
+		}
+	}
+
+	void prepareRow(const Contact& contact, ContactRow& row) const
+	{
+		const Body& bodyA = m_bodies[contact.bodyA];
+
+		row.angularA = contact.rA.cross(row.direction);
+		row.turnA = applyInverseInertia(bodyA, row.angularA);
+		row.speedB = contact.pointVelocityB.dot(row.direction);
+		row.impulse = 0;
+
+		float mass = bodyA.inverseMass + row.turnA.dot(row.angularA);
+
+		if (contact.bodyB >= 0)
+		{
+			const Body& bodyB = m_bodies[contact.bodyB];
+
+			row.angularB = contact.rB.cross(row.direction);
+			row.turnB = applyInverseInertia(bodyB, row.angularB);
+			mass += bodyB.inverseMass + row.turnB.dot(row.angularB);
+		}
+
+		row.mass = 1.0f / mass;
+	}
+
+	void solveContact(Contact& contact)
+	{
+		// Friction first, bounded by the normal impulse of the previous iteration.
+		const float maxFriction = contact.friction * contact.rows[0].impulse;
+
+		for (int j = 1; j < 3; ++j)
+		{
+			ContactRow& row = contact.rows[j];
+			const float previous = row.impulse;
+			row.impulse = jlimit(-maxFriction, maxFriction, previous - row.mass * getSpeed(contact, row));
+
+			applyImpulse(contact, row, row.impulse - previous);
+		}
+
+		ContactRow& row = contact.rows[0];
+		const float previous = row.impulse;
+		row.impulse = jmax(0.0f, previous + row.mass * (contact.targetVelocity - getSpeed(contact, row)));
+
+		applyImpulse(contact, row, row.impulse - previous);
+	}
+
+	// The relative speed of A along a row.
+	float getSpeed(const Contact& contact, const ContactRow& row) const
+	{
+		const Body& bodyA = m_bodies[contact.bodyA];
+		float speed = row.direction.dot(bodyA.velocity) + row.angularA.dot(bodyA.angularVelocity) - row.speedB;
+
+		if (contact.bodyB >= 0)
+		{
+			const Body& bodyB = m_bodies[contact.bodyB];
+			speed -= row.direction.dot(bodyB.velocity) + row.angularB.dot(bodyB.angularVelocity);
+		}
+
+		return speed;
+	}
+
+	void applyImpulse(const Contact& contact, const ContactRow& row, float impulse)
+	{
+		Body& bodyA = m_bodies[contact.bodyA];
+		bodyA.velocity += row.direction * (impulse * bodyA.inverseMass);
+		bodyA.angularVelocity += row.turnA * impulse;
+
+		if (contact.bodyB >= 0)
+		{
+			Body& bodyB = m_bodies[contact.bodyB];
+			bodyB.velocity -= row.direction * (impulse * bodyB.inverseMass);
+			bodyB.angularVelocity -= row.turnB * impulse;
+		}
+	}
+
+	// The world space inverse inertia times v.
+	static Leap::Vector applyInverseInertia(const Body& body, const Leap::Vector& v)
+	{
+		const Leap::Matrix& r = body.rotation;
+
+		return r.xBasis * (body.inverseInertia.x * r.xBasis.dot(v))
+			+ r.yBasis * (body.inverseInertia.y * r.yBasis.dot(v))
+			+ r.zBasis * (body.inverseInertia.z * r.zBasis.dot(v));
+	}
+
+	static void integrate(Body& body, float dt)
+	{
+		body.position += body.velocity * dt;
+
+		const float angularSpeed = body.angularVelocity.magnitude();
+
+		if (angularSpeed * dt < 1e-6f)
+			return;
+
+		Leap::Matrix& r = body.rotation;
+		r = Leap::Matrix(body.angularVelocity / angularSpeed, angularSpeed * dt) * r;
+
+		// Keep the bases orthonormal.
+		r.xBasis = r.xBasis.normalized();
+		r.yBasis = (r.yBasis - r.xBasis * r.xBasis.dot(r.yBasis)).normalized();
+		r.zBasis = r.xBasis.cross(r.yBasis);
+		r.origin = Leap::Vector::zero();
+	}
+
+	void cacheImpulses()
+	{
+		for (int i = 0; i < m_numContacts; ++i)
+		{
+			const Contact& contact = m_contacts[i];
+			CachedImpulse& cached = m_cache[i];
+
+			cached.key = contact.key;
+
+			for (int j = 0; j < 3; ++j)
+				cached.impulses[j] = contact.rows[j].impulse;
+		}
+
+		m_numCached = m_numContacts;
+		std::sort(m_cache.getData(), m_cache.getData() + m_numCached);
+	}
+
+	const CachedImpulse* findCached(int64 key) const
+	{
+		CachedImpulse probe;
+		probe.key = key;
+
+		const CachedImpulse* end = m_cache.getData() + m_numCached;
+		const CachedImpulse* found = std::lower_bound(static_cast<const CachedImpulse*>(m_cache.getData()), end, probe);
+
+		return (found != end && found->key == key) ? found : nullptr;
+	}
+
+	//==============================================================================
+	static Leap::Vector toLocal(const Leap::Vector& position, const Leap::Matrix& rotation, const Leap::Vector& point)
+	{
+		const Leap::Vector offset(point - position);
+
+		return Leap::Vector(rotation.xBasis.dot(offset), rotation.yBasis.dot(offset), rotation.zBasis.dot(offset));
+	}
+
+	static Leap::Vector toWorld(const Leap::Vector& position, const Leap::Matrix& rotation, const Leap::Vector& local)
+	{
+		return position + rotation.xBasis * local.x + rotation.yBasis * local.y + rotation.zBasis * local.z;
+	}
+
+	static Leap::Vector getCorner(const Leap::Vector& position, const Leap::Matrix& rotation, const Leap::Vector& halfExtents,
+		int corner)
+	{
+		return toWorld(position, rotation, Leap::Vector((corner & 1) ? halfExtents.x : -halfExtents.x,
+			(corner & 2) ? halfExtents.y : -halfExtents.y, (corner & 4) ? halfExtents.z : -halfExtents.z));
+	}
+
+	static Leap::Vector clampToBox(const Leap::Vector& local, const Leap::Vector& halfExtents)
+	{
+		return Leap::Vector(jlimit(-halfExtents.x, halfExtents.x, local.x), jlimit(-halfExtents.y, halfExtents.y, local.y),
+			jlimit(-halfExtents.z, halfExtents.z, local.z));
+	}
+
+	// The outward normal of the face nearest a point near or inside the box, and how
+	// far inside that face the point is.
+	static Leap::Vector getNearestFace(const Leap::Matrix& rotation, const Leap::Vector& halfExtents,
+		const Leap::Vector& local, float& depth)
+	{
+		const float depths[3] = { halfExtents.x - std::abs(local.x), halfExtents.y - std::abs(local.y),
+			halfExtents.z - std::abs(local.z) };
+
+		const int axis = depths[0] < depths[1] ? (depths[0] < depths[2] ? 0 : 2) : (depths[1] < depths[2] ? 1 : 2);
+		depth = depths[axis];
+
+		const Leap::Vector& basis = axis == 0 ? rotation.xBasis : (axis == 1 ? rotation.yBasis : rotation.zBasis);
+		return local[axis] < 0 ? -basis : basis;
+	}
+
+	static Leap::Vector closestOnSegment(const Leap::Vector& start, const Leap::Vector& end, const Leap::Vector& point)
+	{
+		const Leap::Vector direction(end - start);
+		const float lengthSquared = direction.dot(direction);
+
+		if (lengthSquared < 1e-12f)
+			return start;
+
+		return start + direction * jlimit(0.0f, 1.0f, (point - start).dot(direction) / lengthSquared);
+	}
+
+	float                    m_fFloorY;
+	float                    m_fGravity;
+
+	Body                     m_bodies[kMaxBodies];
+	int                      m_numBodies;
+
+	Collider                 m_colliders[kMaxColliders];
+	int                      m_numColliders;
+	Collider                 m_previousColliders[kMaxColliders];
+	int                      m_numPreviousColliders;
+
+	// Allocated once, scenes live on the stack of the headless threads.
+	HeapBlock<Contact>       m_contacts;
+	int                      m_numContacts;
+	HeapBlock<CachedImpulse> m_cache;
+	int                      m_numCached;
+
+	bool                     m_bHasTimestamp;
+	int64                    m_lastTimestamp;
+};
+
+#endif // VIRTUALHANDS_CONTACTSOLVER_H
@@ -0,0 +1,238 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_DRAWLIST_H
+#define VIRTUALHANDS_DRAWLIST_H
+
+#include "GL/glew.h"
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LeapUtilGL.h"
+
+// To float vector argument passed to GL functions
+struct GLColor
+{
+	GLColor() : r(1), g(1), b(1), a(1) {}
+
+	GLColor(float _r, float _g, float _b, float _a=1)
+		: r(_r), g(_g), b(_b), a(_a)
+	{}
+
+	explicit GLColor(const Colour& juceColor)
+		: r(juceColor.getFloatRed()),
+		g(juceColor.getFloatGreen()),
+		b(juceColor.getFloatBlue()),
+		a(juceColor.getFloatAlpha())
+	{}
+
+	operator const GLfloat*() const { return &r; }
+
+	GLfloat r, g, b, a;
+};
+
+//==============================================================================
+struct DrawCommand
+{
+	enum Type
+	{
+		kType_Sphere,
+		kType_Box,
+		kType_Line
+	};
+
+	Type         type;
+	bool         bBlend;
+	GLColor      color;
+	Leap::Matrix transform;   // model matrix of spheres and boxes
+	Leap::Vector lineStart;
+	Leap::Vector lineEnd;
+	Leap::Vector boundsCentre;
+	float        boundsRadius;
+};
+
+//==============================================================================
+// What a camera can see, for skipping draw commands before they reach GL.
+// Built from the camera alone, so it costs nothing on the GL side.
+class ViewFrustum
+{
+public:
+	explicit ViewFrustum(const LeapUtilGL::CameraGL& camera)
+		: m_worldToCamera(camera.GetPOV().rigidInverse()),
+		m_fNear(camera.GetNearClip()),
+		m_fFar(camera.GetFarClip())
+	{
+		const float DEG_2_RAD = 0.0174532925f;
+
+		m_fTanY = std::tan(camera.GetVerticalFOVDegrees() * 0.5f * DEG_2_RAD);
+		m_fTanX = m_fTanY * camera.GetAspectRatio();
+		m_fInvLengthX = 1.0f / std::sqrt(1.0f + m_fTanX * m_fTanX);
+		m_fInvLengthY = 1.0f / std::sqrt(1.0f + m_fTanY * m_fTanY);
+	}
+
+	enum Containment { kOutside, kIntersecting, kInside };
+
+	bool isVisible(const Leap::Vector& centre, float radius) const
+	{
+		return classify(centre, radius) != kOutside;
+	}
+
+	// Whether a bounding sphere is outside, partly inside or wholly inside. Lets a
+	// hierarchy skip the tests below a node that is wholly inside.
+	Containment classify(const Leap::Vector& centre, float radius) const
+	{
+		// The camera looks down its negative z axis.
+		const Leap::Vector p = m_worldToCamera.transformPoint(centre);
+		const float depth = -p.z;
+
+		// Signed distances outside each plane, the side planes both sides at once.
+		const float distance = jmax(jmax(m_fNear - depth, depth - m_fFar),
+			(std::abs(p.x) - depth * m_fTanX) * m_fInvLengthX,
+			(std::abs(p.y) - depth * m_fTanY) * m_fInvLengthY);
+
+		if (distance > radius)
+			return kOutside;
+
+		return distance < -radius ? kInside : kIntersecting;
+	}
+
+private:
+	Leap::Matrix m_worldToCamera;
+	float        m_fNear;
+	float        m_fFar;
+	float        m_fTanX;
+	float        m_fTanY;
+	float        m_fInvLengthX;
+	float        m_fInvLengthY;
+};
+
+//==============================================================================
+// Everything a part of the scene draws, recorded without touching GL so it can be
+// built on any thread, then submitted on the GL thread. Clearing keeps the storage,
+// so a list that is rebuilt every frame stops allocating once it has warmed up.
+class DrawList
+{
+public:
+	void clear()                 { m_commands.clearQuick(); }
+	int size() const             { return m_commands.size(); }
+
+	void addSphere(const Leap::Matrix& transform, const GLColor& color, bool bBlend = false)
+	{
+		add(DrawCommand::kType_Sphere, transform, color, bBlend);
+	}
+
+	void addBox(const Leap::Matrix& transform, const GLColor& color, bool bBlend = false)
+	{
+		add(DrawCommand::kType_Box, transform, color, bBlend);
+	}
+
+	void addLine(const Leap::Vector& start, const Leap::Vector& end, const GLColor& color, bool bBlend = false)
+	{
+		DrawCommand& command = add(DrawCommand::kType_Line, Leap::Matrix::identity(), color, bBlend);
+		command.lineStart = start;
+		command.lineEnd = end;
+		command.boundsCentre = (start + end) / 2;
+		command.boundsRadius = start.distanceTo(end) / 2;
+	}
+
+	// Consecutive lines go into a single glBegin/glEnd pair. With a frustum,
+	// only what it can see is drawn.
+	void submit(const ViewFrustum* pFrustum = nullptr) const
+	{
+		LeapUtilGL::GLAttribScope attribScope(GL_CURRENT_BIT | GL_ENABLE_BIT);
+
+		const int numCommands = m_commands.size();
+		bool bBlendEnabled = glIsEnabled(GL_BLEND) != GL_FALSE;
+
+		for (int i = 0; i < numCommands; ++i)
+		{
+			const DrawCommand& command = m_commands.getReference(i);
+
+			if (!isVisible(command, pFrustum))
+				continue;
+
+			if (command.bBlend != bBlendEnabled)
+			{
+				if (command.bBlend)
+					glEnable(GL_BLEND);
+				else
+					glDisable(GL_BLEND);
+
+				bBlendEnabled = command.bBlend;
+			}
+
+			glColor4fv(command.color);
+
+			if (command.type == DrawCommand::kType_Line)
+			{
+				glBegin(GL_LINES);
+
+				for (;;)
+				{
+					const DrawCommand& line = m_commands.getReference(i);
+
+					if (isVisible(line, pFrustum))
+					{
+						glVertex3fv(line.lineStart.toFloatPointer());
+						glVertex3fv(line.lineEnd.toFloatPointer());
+					}
+
+					if (i + 1 == numCommands || !continuesLines(m_commands.getReference(i + 1), command))
+						break;
+
+					++i;
+				}
+
+				glEnd();
+				continue;
+			}
+
+			glPushMatrix();
+			glMultMatrixf(command.transform.toArray4x4());
+
+			if (command.type == DrawCommand::kType_Sphere)
+				LeapUtilGL::drawSphere(LeapUtilGL::kStyle_Solid);
+			else
+				LeapUtilGL::drawBox(LeapUtilGL::kStyle_Solid);
+
+			glPopMatrix();
+		}
+	}
+
+private:
+	DrawCommand& add(DrawCommand::Type type, const Leap::Matrix& transform, const GLColor& color, bool bBlend)
+	{
+		m_commands.add(DrawCommand());
+
+		DrawCommand& command = m_commands.getReference(m_commands.size() - 1);
+		command.type = type;
+		command.bBlend = bBlend;
+		command.color = color;
+		command.transform = transform;
+
+		// Unit spheres and boxes both fit in a sphere of radius sqrt(3)/2 before scaling.
+		command.boundsCentre = transform.origin;
+		command.boundsRadius = 0.8660254f * jmax(transform.xBasis.magnitude(),
+			transform.yBasis.magnitude(), transform.zBasis.magnitude());
+		return command;
+	}
+
+	static bool isVisible(const DrawCommand& command, const ViewFrustum* pFrustum)
+	{
+		return pFrustum == nullptr || pFrustum->isVisible(command.boundsCentre, command.boundsRadius);
+	}
+
+	static bool continuesLines(const DrawCommand& next, const DrawCommand& first)
+	{
+		return next.type == DrawCommand::kType_Line
+			&& next.bBlend == first.bBlend
+			&& next.color.r == first.color.r && next.color.g == first.color.g
+			&& next.color.b == first.color.b && next.color.a == first.color.a;
+	}
+
+	Array<DrawCommand> m_commands;
+};
+
+#endif // VIRTUALHANDS_DRAWLIST_H
@@ -0,0 +1,438 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_FINGERTRAILS_H
+#define VIRTUALHANDS_FINGERTRAILS_H
+
+#include "GL/glew.h"
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "HandSnapshot.h"
+#include "HandSkeleton.h"
+#include "TraceEvents.h"
+
+//==============================================================================
+// The paths of the fingertips over the last few seconds, fading with age.
+//
+// Every update adds one line segment per tracked fingertip. Segments are written once,
+// straight into a persistently mapped vertex buffer used as a ring, and never uploaded
+// again: all trails are drawn with a single call and the shader fades them by age.
+// The ring has room for kNumFences repaints of writes past the drawn history, and a
+// fence per repaint keeps new writes away from vertices the GPU may still be reading.
+class FingerTrails
+{
+public:
+	enum
+	{
+		kMaxTrails         = FrameSnapshot::kMaxHands * HandSnapshot::kMaxFingers,
+		kTrailSeconds      = 3,
+		kHistoryVertices   = 1 << 15,   // kTrailSeconds at 200Hz for 20 fingertips, two vertices a segment
+		kMaxUploadVertices = 1 << 12,   // per repaint, older segments are dropped past that
+		kNumFences         = 3,
+		kCapacity          = kHistoryVertices + kNumFences * kMaxUploadVertices
+	};
+
+	FingerTrails()
+		: m_bEnabled(false),
+		m_epoch(-1),
+		m_lastTimestamp(0),
+		m_numTips(0),
+		m_fPendingNow(0),
+		m_bResetRequested(false),
+		m_program(0),
+		m_buffer(0),
+		m_vertices(nullptr),
+		m_head(0),
+		m_numVertices(0),
+		m_fNow(0),
+		m_iFence(0),
+		m_bDrawnSinceFence(false),
+		m_nowUniform(-1),
+		m_durationUniform(-1)
+	{
+		for (int i = 0; i < kNumFences; ++i)
+			m_fences[i] = 0;
+	}
+
+	bool isEnabled() const          { return m_bEnabled; }
+	void setEnabled(bool bEnabled)  { m_bEnabled = bEnabled; }
+
+	// Needs GL 4.4 or ARB_buffer_storage. Without it the trails stay hidden.
+	bool initGL()
+	{
+		// The window never initialises GLEW anywhere else, headless rendering already has.
+		if (glBufferStorage == nullptr)
+		{
+			glewExperimental = GL_TRUE;
+			glewInit();
+		}
+
+		if (glBufferStorage == nullptr || glFenceSync == nullptr || glCreateProgram == nullptr
+			|| glMultiDrawArrays == nullptr)
+		{
+			Logger::writeToLog("Fingertip trails need persistently mapped buffers (GL 4.4 or ARB_buffer_storage)");
+			return false;
+		}
+
+		m_program = createProgram();
+
+		if (m_program == 0)
+			return false;
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const GLsizeiptr size = (GLsizeiptr) kCapacity * sizeof(TrailVertex);
+
+		glGenBuffers(1, &m_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+		glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+		m_vertices = static_cast<TrailVertex*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		if (m_vertices == nullptr)
+		{
+			Logger::writeToLog("Could not map the fingertip trail buffer");
+			releaseGL();
+			return false;
+		}
+
+		m_head = 0;
+		m_numVertices = 0;
+		return true;
+	}
+
+	// Needs the context current. Contexts that are destroyed anyway can skip it.
+	void releaseGL()
+	{
+		for (int i = 0; i < kNumFences; ++i)
+		{
+			if (m_fences[i] != 0)
+				glDeleteSync(m_fences[i]);
+
+			m_fences[i] = 0;
+		}
+
+		if (m_buffer != 0)
+		{
+			if (m_vertices != nullptr)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+				glUnmapBuffer(GL_ARRAY_BUFFER);
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+			}
+
+			glDeleteBuffers(1, &m_buffer);
+		}
+
+		if (m_program != 0)
+			glDeleteProgram(m_program);
+
+		m_vertices = nullptr;
+		m_buffer = 0;
+		m_program = 0;
+	}
+
+	//==============================================================================
+	// Adds a segment from where each fingertip was on the previous frame to where it
+	// is now. Called from the update, no GL needed.
+	void addFrame(const FrameSnapshot& frame, const SceneTransform& transform)
+	{
+		if (!m_bEnabled)
+		{
+			m_numTips = 0;
+			return;
+		}
+
+		// Replays can jump back, start over rather than join the paths up.
+		if (m_epoch < 0 || frame.timestamp < m_lastTimestamp)
+		{
+			const SpinLock::ScopedLockType sl(m_pendingLock);
+			m_pending.clearQuick();
+			m_bResetRequested = true;
+
+			m_epoch = frame.timestamp;
+			m_numTips = 0;
+		}
+
+		m_lastTimestamp = frame.timestamp;
+
+		const float time = static_cast<float>((frame.timestamp - m_epoch) / 1000000.0);
+		Tip tips[kMaxTrails];
+		int numTips = 0;
+
+		const SpinLock::ScopedLockType sl(m_pendingLock);
+
+		for (int handCount = 0; handCount < frame.numHands; ++handCount)
+		{
+			const HandSnapshot& hand = frame.hands[handCount];
+
+			for (int fingerCount = 0; fingerCount < hand.numFingers; ++fingerCount)
+			{
+				const FingerSnapshot& finger = hand.fingers[fingerCount];
+				Tip& tip = tips[numTips++];
+
+				tip.fingerId = finger.id;
+				tip.position = transform.toScene(transform.useStabilizedPos ? finger.stabilizedTipPosition : finger.tipPosition);
+
+				// Leap keeps finger ids while it keeps tracking a finger.
+				for (int i = 0; i < m_numTips; ++i)
+				{
+					if (m_tips[i].fingerId == finger.id)
+					{
+						m_pending.add(TrailVertex(m_tips[i].position, m_fPendingNow, fingerCount));
+						m_pending.add(TrailVertex(tip.position, time, fingerCount));
+						break;
+					}
+				}
+			}
+		}
+
+		for (int i = 0; i < numTips; ++i)
+			m_tips[i] = tips[i];
+
+		m_numTips = numTips;
+		m_fPendingNow = time;
+
+		// When nothing has been drawing for a while, keep only what one repaint can take.
+		if (m_pending.size() > kMaxUploadVertices)
+			m_pending.removeRange(0, m_pending.size() - kMaxUploadVertices);
+	}
+
+	// Writes the segments added since the last call into the ring. Call once per repaint.
+	void upload()
+	{
+		if (m_vertices == nullptr)
+			return;
+
+		TRACE_SCOPE("uploadTrails");
+
+		{
+			const SpinLock::ScopedLockType sl(m_pendingLock);
+			m_uploading.swapWith(m_pending);
+			m_fNow = m_fPendingNow;
+
+			if (m_bResetRequested)
+			{
+				m_numVertices = 0;
+				m_bResetRequested = false;
+			}
+		}
+
+		// Fences the previous repaint's draws, then waits for the oldest repaint to finish.
+		if (m_bDrawnSinceFence)
+		{
+			m_fences[m_iFence] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			m_iFence = (m_iFence + 1) % kNumFences;
+			m_bDrawnSinceFence = false;
+		}
+
+		if (m_fences[m_iFence] != 0)
+		{
+			while (glClientWaitSync(m_fences[m_iFence], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+			{
+			}
+
+			glDeleteSync(m_fences[m_iFence]);
+			m_fences[m_iFence] = 0;
+		}
+
+		// Segments come in pairs and the capacity is even, so none wraps around the end.
+		const int numNew = m_uploading.size();
+
+		for (int i = 0; i < numNew; ++i)
+		{
+			m_vertices[m_head] = m_uploading.getReference(i);
+			m_head = (m_head + 1) % kCapacity;
+		}
+
+		m_numVertices = jmin(m_numVertices + numNew, (int) kHistoryVertices);
+		m_uploading.clearQuick();
+	}
+
+	// Draws every trail with one call, in the current view.
+	void draw()
+	{
+		if (!m_bEnabled || m_vertices == nullptr || m_numVertices == 0)
+			return;
+
+		TRACE_SCOPE("drawTrails");
+
+		// The history ends at the head and may wrap around the end of the ring.
+		const int start = (m_head - m_numVertices + kCapacity) % kCapacity;
+		GLint firsts[2] = { start, 0 };
+		GLsizei counts[2] = { jmin(m_numVertices, kCapacity - start), 0 };
+		counts[1] = m_numVertices - counts[0];
+
+		glUseProgram(m_program);
+		glUniform1f(m_nowUniform, m_fNow);
+		glUniform1f(m_durationUniform, static_cast<float>(kTrailSeconds));
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+		glEnableVertexAttribArray(kPositionAttribute);
+		glEnableVertexAttribArray(kFingerAttribute);
+		glVertexAttribPointer(kPositionAttribute, 4, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (const GLvoid*) 0);
+		glVertexAttribPointer(kFingerAttribute, 1, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (const GLvoid*) (4 * sizeof(float)));
+
+		// Faded segments should not hide the ones behind them.
+		glDepthMask(GL_FALSE);
+		glLineWidth(2.0f);
+		glMultiDrawArrays(GL_LINES, firsts, counts, counts[1] > 0 ? 2 : 1);
+		glLineWidth(1.0f);
+		glDepthMask(GL_TRUE);
+
+		glDisableVertexAttribArray(kFingerAttribute);
+		glDisableVertexAttribArray(kPositionAttribute);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glUseProgram(0);
+
+		m_bDrawnSinceFence = true;
+	}
+
+private:
+	enum { kPositionAttribute = 0, kFingerAttribute = 1 };
+
+	// Scene position and the time since the first frame in w, in seconds.
+	struct TrailVertex
+	{
+		TrailVertex() {}
+
+		TrailVertex(const Leap::Vector& position, float time, int fingerCount)
+			: x(position.x), y(position.y), z(position.z), t(time), finger(static_cast<float>(fingerCount))
+		{}
+
+		float x, y, z, t;
+		float finger;
+	};
+
+	struct Tip
+	{
+		int32        fingerId;
+		Leap::Vector position;
+	};
+
+	GLuint createProgram()
+	{
+		static const char* vertexShader =
+			"#version 120\n"
+			"attribute vec4 position;\n"
+			"attribute float finger;\n"
+			"uniform float now;\n"
+			"uniform float duration;\n"
+			"uniform vec3 colours[5];\n"
+			"varying vec4 colour;\n"
+			"void main()\n"
+			"{\n"
+			"    float alpha = clamp(1.0 - (now - position.w) / duration, 0.0, 1.0);\n"
+			"    colour = vec4(colours[int(finger)], alpha * alpha);\n"
+			"    gl_Position = gl_ModelViewProjectionMatrix * vec4(position.xyz, 1.0);\n"
+			"}\n";
+
+		static const char* fragmentShader =
+			"#version 120\n"
+			"varying vec4 colour;\n"
+			"void main()\n"
+			"{\n"
+			"    gl_FragColor = colour;\n"
+			"}\n";
+
+		GLuint program = glCreateProgram();
+		const GLuint shaders[] = { compileShader(GL_VERTEX_SHADER, vertexShader),
+			compileShader(GL_FRAGMENT_SHADER, fragmentShader) };
+
+		for (int i = 0; i < numElementsInArray(shaders); ++i)
+		{
+			if (shaders[i] != 0)
+			{
+				glAttachShader(program, shaders[i]);
+				glDeleteShader(shaders[i]);
+			}
+		}
+
+		glBindAttribLocation(program, kPositionAttribute, "position");
+		glBindAttribLocation(program, kFingerAttribute, "finger");
+		glLinkProgram(program);
+
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+		if (linked != GL_TRUE || shaders[0] == 0 || shaders[1] == 0)
+		{
+			char log[1024] = { 0 };
+			glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+			Logger::writeToLog("Could not link the fingertip trail shader: " + String(log));
+
+			glDeleteProgram(program);
+			return 0;
+		}
+
+		m_nowUniform = glGetUniformLocation(program, "now");
+		m_durationUniform = glGetUniformLocation(program, "duration");
+
+		// Thumb to little finger, as far as Leap orders them.
+		const GLfloat colours[HandSnapshot::kMaxFingers * 3] = {
+			1.0f, 0.3f, 0.1f,
+			1.0f, 0.8f, 0.0f,
+			0.2f, 0.9f, 0.3f,
+			0.1f, 0.6f, 1.0f,
+			0.8f, 0.3f, 1.0f };
+
+		glUseProgram(program);
+		glUniform3fv(glGetUniformLocation(program, "colours"), HandSnapshot::kMaxFingers, colours);
+		glUseProgram(0);
+
+		return program;
+	}
+
+	static GLuint compileShader(GLenum type, const char* source)
+	{
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, nullptr);
+		glCompileShader(shader);
+
+		GLint compiled = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+
+		if (compiled != GL_TRUE)
+		{
+			char log[1024] = { 0 };
+			glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+			Logger::writeToLog("Could not compile the fingertip trail shader: " + String(log));
+
+			glDeleteShader(shader);
+			return 0;
+		}
+
+		return shader;
+	}
+
+	// Update side
+	volatile bool      m_bEnabled;
+	int64              m_epoch;
+	int64              m_lastTimestamp;
+	Tip                m_tips[kMaxTrails];
+	int                m_numTips;
+
+	// Handed from the update to the render thread
+	SpinLock           m_pendingLock;
+	Array<TrailVertex> m_pending;
+	float              m_fPendingNow;
+	bool               m_bResetRequested;
+
+	// Render side
+	Array<TrailVertex> m_uploading;
+	GLuint             m_program;
+	GLuint             m_buffer;
+	TrailVertex*       m_vertices;
+	int                m_head;
+	int                m_numVertices;
+	float              m_fNow;
+	GLsync             m_fences[kNumFences];
+	int                m_iFence;
+	bool               m_bDrawnSinceFence;
+	GLint              m_nowUniform;
+	GLint              m_durationUniform;
+};
+
+#endif // VIRTUALHANDS_FINGERTRAILS_H
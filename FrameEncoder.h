@@ -0,0 +1,359 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_FRAMEENCODER_H
+#define VIRTUALHANDS_FRAMEENCODER_H
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TraceEvents.h"
+
+//==============================================================================
+// One read back frame: BGRA bytes, bottom row first as glReadPixels returns them.
+struct CapturedFrame
+{
+	CapturedFrame(int width, int height, bool withYuv)
+		: index(0),
+		pixels((size_t) width * height * 4)
+	{
+		if (withYuv)
+			yuv.allocate((size_t) width * height * 3 / 2, false);
+	}
+
+	int64            index;
+	HeapBlock<uint8> pixels;
+	HeapBlock<uint8> yuv;    // I420 planes, only used for Y4M output
+};
+
+//==============================================================================
+// Encodes captured frames on a pool of worker threads.
+// PNG output writes one file per frame from any worker. Y4M output converts in
+// parallel but appends to the single stream strictly in frame order.
+// The frame pool is bounded. Once every buffer is queued, acquireFrame() either
+// waits for an encoder, throttling the caller to the encoders, or drops the frame.
+class FrameEncoder
+{
+public:
+	enum Format
+	{
+		kFormat_PNG,
+		kFormat_Y4M
+	};
+
+	FrameEncoder(const File& output, Format format, int width, int height, int fps, int numThreads, bool dropWhenBehind)
+		: m_output(output),
+		m_format(format),
+		m_width(width),
+		m_height(height),
+		m_maxFrames(2 * jmax(1, numThreads) + 2),
+		m_bDropWhenBehind(dropWhenBehind),
+		m_numDropped(0),
+		m_nextWriteIndex(0),
+		m_allDone(true),
+		m_pool(jmax(1, numThreads))
+	{
+		if (m_format == kFormat_Y4M)
+		{
+			m_output.deleteFile();
+			m_y4mStream = new FileOutputStream(m_output, 1 << 20);
+
+			if (m_y4mStream->failedToOpen())
+			{
+				m_y4mStream = nullptr;
+			}
+			else
+			{
+				*m_y4mStream << "YUV4MPEG2 W" << m_width << " H" << m_height
+					<< " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+			}
+		}
+		else
+		{
+			m_output.createDirectory();
+		}
+	}
+
+	~FrameEncoder()
+	{
+		finish();
+	}
+
+	bool isOpen() const
+	{
+		return m_format == kFormat_PNG ? m_output.isDirectory() : m_y4mStream != nullptr;
+	}
+
+	// Hands out a free frame buffer for the given frame. The pool grows up to a couple
+	// of frames per encoder thread; past that this waits for the encoders to release
+	// one, or returns nullptr if frames are dropped while the encoders are behind.
+	CapturedFrame* acquireFrame(int64 index)
+	{
+		for (;;)
+		{
+			CapturedFrame* frame = nullptr;
+
+			{
+				const ScopedLock sl(m_frameLock);
+
+				if (m_freeFrames.size() > 0)
+					frame = m_freeFrames.removeAndReturn(m_freeFrames.size() - 1);
+				else if (m_allFrames.size() < m_maxFrames)
+					frame = m_allFrames.add(new CapturedFrame(m_width, m_height, m_format == kFormat_Y4M));
+				else if (m_bDropWhenBehind)
+					++m_numDropped;
+			}
+
+			if (frame != nullptr)
+			{
+				frame->index = index;
+				return frame;
+			}
+
+			if (m_bDropWhenBehind)
+			{
+				skipIndex(index);
+				return nullptr;
+			}
+
+			TRACE_SCOPE("waitForEncoder");
+			m_frameReleased.wait(-1);
+		}
+	}
+
+	void submitFrame(CapturedFrame* frame)
+	{
+		if (++m_numPending == 1)
+			m_allDone.reset();
+
+		m_pool.addJob(new EncodeJob(*this, frame), true);
+	}
+
+	// Returns an acquired frame that could not be read back, so the Y4M stream does
+	// not wait on it forever.
+	void discardFrame(CapturedFrame* frame)
+	{
+		const int64 index = frame->index;
+		Logger::writeToLog("Frame " + String(index) + " could not be read back and is missing from the output");
+
+		{
+			const ScopedLock sl(m_frameLock);
+			m_freeFrames.add(frame);
+		}
+
+		m_frameReleased.signal();
+		skipIndex(index);
+	}
+
+	// Blocks until every submitted frame has been written.
+	void finish()
+	{
+		while (m_numPending.get() > 0)
+			m_allDone.wait(100);
+
+		if (m_y4mStream != nullptr)
+			m_y4mStream->flush();
+	}
+
+	// Number of frame buffers allocated, a measure of how far encoding lagged behind.
+	int getNumFrameBuffers() const
+	{
+		const ScopedLock sl(m_frameLock);
+		return m_allFrames.size();
+	}
+
+	int64 getNumDroppedFrames() const
+	{
+		const ScopedLock sl(m_frameLock);
+		return m_numDropped;
+	}
+
+private:
+	class EncodeJob : public ThreadPoolJob
+	{
+	public:
+		EncodeJob(FrameEncoder& owner, CapturedFrame* frame)
+			: ThreadPoolJob("EncodeJob"),
+			m_owner(owner),
+			m_frame(frame)
+		{}
+
+		JobStatus runJob()
+		{
+			TRACE_SCOPE("encodeFrame");
+
+			if (m_owner.m_format == kFormat_PNG)
+				m_owner.writePNG(*m_frame);
+			else
+				m_owner.writeY4M(m_frame);
+
+			return jobHasFinished;
+		}
+
+	private:
+		FrameEncoder&  m_owner;
+		CapturedFrame* m_frame;
+	};
+
+	void writePNG(CapturedFrame& frame)
+	{
+		// Destination alpha is whatever the blended shadows left behind, so it is dropped.
+		Image image(Image::RGB, m_width, m_height, false);
+
+		{
+			Image::BitmapData bitmap(image, Image::BitmapData::writeOnly);
+
+			// GL rows start at the bottom; the bytes are B, G, R, A.
+			for (int y = 0; y < m_height; ++y)
+			{
+				const uint8* src = frame.pixels + (size_t) m_width * 4 * (m_height - 1 - y);
+				uint8* dst = bitmap.getLinePointer(y);
+
+				for (int x = 0; x < m_width; ++x, src += 4, dst += bitmap.pixelStride)
+					((PixelRGB*) dst)->setARGB(0xff, src[2], src[1], src[0]);
+			}
+		}
+
+		File file(m_output.getChildFile("frame_" + String(frame.index).paddedLeft('0', 6) + ".png"));
+		file.deleteFile();
+
+		{
+			FileOutputStream stream(file);
+
+			if (! stream.failedToOpen())
+				PNGImageFormat().writeImageToStream(image, stream);
+		}
+
+		releaseFrame(&frame);
+	}
+
+	void writeY4M(CapturedFrame* frame)
+	{
+		convertToI420(*frame);
+
+		const ScopedLock sl(m_writeLock);
+
+		m_readyFrames.add(frame);
+		writeReadyFrames();
+	}
+
+	void skipIndex(int64 index)
+	{
+		if (m_format != kFormat_Y4M)
+			return;
+
+		const ScopedLock sl(m_writeLock);
+
+		m_skippedFrames.add(index);
+		writeReadyFrames();
+	}
+
+	// Whoever completes the next frame in sequence drains everything that is now in order.
+	void writeReadyFrames()
+	{
+		for (;;)
+		{
+			if (m_skippedFrames.contains(m_nextWriteIndex))
+			{
+				m_skippedFrames.removeFirstMatchingValue(m_nextWriteIndex);
+				++m_nextWriteIndex;
+				continue;
+			}
+
+			CapturedFrame* next = nullptr;
+
+			for (int i = 0; i < m_readyFrames.size(); ++i)
+			{
+				if (m_readyFrames[i]->index == m_nextWriteIndex)
+				{
+					next = m_readyFrames.removeAndReturn(i);
+					break;
+				}
+			}
+
+			if (next == nullptr)
+				return;
+
+			if (m_y4mStream != nullptr)
+			{
+				*m_y4mStream << "FRAME\n";
+				m_y4mStream->write(next->yuv, (size_t) m_width * m_height * 3 / 2);
+			}
+
+			++m_nextWriteIndex;
+			releaseFrame(next);
+		}
+	}
+
+	// Full range BT.601, which is what C420jpeg declares.
+	void convertToI420(CapturedFrame& frame) const
+	{
+		const int chromaWidth = m_width / 2;
+		uint8* yPlane = frame.yuv;
+		uint8* uPlane = yPlane + m_width * m_height;
+		uint8* vPlane = uPlane + chromaWidth * (m_height / 2);
+
+		for (int y = 0; y < m_height; ++y)
+		{
+			const uint8* src = frame.pixels + (size_t) m_width * 4 * (m_height - 1 - y);
+			uint8* dstY = yPlane + m_width * y;
+
+			for (int x = 0; x < m_width; ++x, src += 4)
+				dstY[x] = (uint8) ((77 * src[2] + 150 * src[1] + 29 * src[0] + 128) >> 8);
+		}
+
+		for (int y = 0; y < m_height / 2; ++y)
+		{
+			const uint8* src = frame.pixels + (size_t) m_width * 4 * (m_height - 1 - y * 2);
+
+			for (int x = 0; x < chromaWidth; ++x, src += 8)
+			{
+				const int b = src[0], g = src[1], r = src[2];
+				uPlane[chromaWidth * y + x] = (uint8) jlimit(0, 255, ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128);
+				vPlane[chromaWidth * y + x] = (uint8) jlimit(0, 255, ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128);
+			}
+		}
+	}
+
+	void releaseFrame(CapturedFrame* frame)
+	{
+		{
+			const ScopedLock sl(m_frameLock);
+			m_freeFrames.add(frame);
+		}
+
+		m_frameReleased.signal();
+
+		if (--m_numPending == 0)
+			m_allDone.signal();
+	}
+
+	File                            m_output;
+	Format                          m_format;
+	int                             m_width;
+	int                             m_height;
+
+	CriticalSection                 m_frameLock;
+	OwnedArray<CapturedFrame>       m_allFrames;
+	Array<CapturedFrame*>           m_freeFrames;
+	int                             m_maxFrames;
+	bool                            m_bDropWhenBehind;
+	int64                           m_numDropped;
+	WaitableEvent                   m_frameReleased;
+
+	CriticalSection                 m_writeLock;
+	ScopedPointer<FileOutputStream> m_y4mStream;
+	Array<CapturedFrame*>           m_readyFrames;
+	Array<int64>                    m_skippedFrames;
+	int64                           m_nextWriteIndex;
+
+	Atomic<int>                     m_numPending;
+	WaitableEvent                   m_allDone;
+
+	// Last, so the workers are gone before anything they use is destroyed.
+	ThreadPool                      m_pool;
+};
+
+#endif // VIRTUALHANDS_FRAMEENCODER_H
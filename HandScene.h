@@ -0,0 +1,687 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_HANDSCENE_H
+#define VIRTUALHANDS_HANDSCENE_H
+
+#include "GL/glew.h"
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LeapUtilGL.h"
+#include "HandSnapshot.h"
+#include "HandSkeleton.h"
+#include "DrawList.h"
+#include "ContactSolver.h"
+#include "JobSystem.h"
+#include "FingerTrails.h"
+#include "PoseLibrary.h"
+#include "StaticScene.h"
+#include "StaticSceneRenderer.h"
+#include "TraceEvents.h"
+
+//==============================================================================
+// The hands, floor and demo bodies, independent of where they are drawn to.
+// OpenGLCanvas draws it into the window, HeadlessRenderer into an offscreen framebuffer.
+//
+// Each update runs as a job graph: per hand a skeleton job followed by a draw list
+// job, the demo physics after every skeleton followed by its draw list, and the
+// fingertip queries against the static scene. Processed frames are triple
+// buffered, so render() can submit the latest finished frame while the next one is
+// still being built on the workers.
+class HandScene
+{
+public:
+	HandScene()
+		: m_fTipRadius(4.0f),
+		m_useStabelizedPos(false),
+		m_bShowDemo(true),
+		m_fHandY(0),
+		m_fShadowScale(2.0f),
+		m_bUpdateStarted(false),
+		m_iBuilding(0),
+		m_iReady(1),
+		m_iDisplayed(2),
+		m_bNewFrameReady(false),
+		m_jobSystem(JobSystem::getSharedInstance())
+	{
+		m_vSphereInitialPos = Leap::Vector(0.1f, -1.6f, -0.6f);
+		m_fSphereRadius = 50 * m_transform.frameScale;
+		m_fShadowsYPos = m_vSphereInitialPos.y - m_fSphereRadius;
+
+		m_physics.setFloor(m_fShadowsYPos);
+		m_physics.setGravity(9810.0f * m_transform.frameScale);
+		resetDemoBodies();
+
+		buildBackground();
+
+		for (int i = 0; i < kNumProcessedFrames; ++i)
+		{
+			m_frames[i].bShowDemo = m_bShowDemo;
+			fillDemoDrawList(m_frames[i]);
+		}
+
+		SceneJob* pDemoJob = new SceneJob(*this, &HandScene::updateDemo, 0);
+
+		for (int handCount = 0; handCount < FrameSnapshot::kMaxHands; ++handCount)
+		{
+			SceneJob* pSkeletonJob = m_jobs.add(new SceneJob(*this, &HandScene::buildSkeleton, handCount));
+			SceneJob* pDrawJob = m_jobs.add(new SceneJob(*this, &HandScene::buildHandDrawLists, handCount));
+
+			pDrawJob->runsAfter(*pSkeletonJob);
+			pDemoJob->runsAfter(*pSkeletonJob);
+		}
+
+		m_jobs.add(new SceneJob(*this, &HandScene::addTrailSegments, 0));
+
+		for (int handCount = 0; handCount < FrameSnapshot::kMaxHands; ++handCount)
+			m_jobs.add(new SceneJob(*this, &HandScene::matchPose, handCount));
+
+		m_jobs.add(new SceneJob(*this, &HandScene::findTouchedProps, 0));
+
+		m_jobs.add(pDemoJob);
+		SceneJob* pDemoDrawJob = m_jobs.add(new SceneJob(*this, &HandScene::buildDemoDrawList, 0));
+		pDemoDrawJob->runsAfter(*pDemoJob);
+
+		for (int i = 0; i < m_jobs.size(); ++i)
+			m_graph.add(*m_jobs[i]);
+	}
+
+	~HandScene()
+	{
+		m_graph.wait();
+	}
+
+	// Applied by the next update, the demo state belongs to the update jobs.
+	void resetDemo()              { m_resetDemoRequested = 1; }
+	void toggleDemo()             { m_bShowDemo = !m_bShowDemo; }
+	void toggleStabilizedPos()    { m_useStabelizedPos = !m_useStabelizedPos; }
+	void toggleTrails()           { m_trails.setEnabled(!m_trails.isEnabled()); }
+
+	// Every hand is matched against the library on each update. Takes ownership,
+	// nullptr stops matching.
+	void setPoseLibrary(PoseLibrary* library)
+	{
+		ScopedPointer<PoseLibrary> previous;
+
+		const ScopedLock sl(m_updateLock);
+		previous = m_poseLibrary.release();
+		m_poseLibrary = library;
+	}
+
+	const PoseLibrary* getPoseLibrary() const  { return m_poseLibrary; }
+
+	// Props drawn with the floor, and highlighted where fingertips touch them. Takes
+	// ownership. The render thread reads it without locking, so set it before rendering.
+	void setStaticScene(StaticScene* scene)
+	{
+		ScopedPointer<StaticScene> previous;
+
+		const ScopedLock sl(m_updateLock);
+		previous = m_staticScene.release();
+		m_staticScene = scene;
+	}
+
+	// Features of a hand in the newest processed frame, for adding it to a library.
+	bool getLatestPoseFeatures(int hand, float* features) const
+	{
+		const SpinLock::ScopedLockType sl(m_swapLock);
+		const ProcessedFrame& frame = m_frames[m_bNewFrameReady ? m_iReady : m_iDisplayed];
+
+		if (hand >= frame.snapshot.numHands)
+			return false;
+
+		memcpy(features, frame.poseFeatures[hand], sizeof(frame.poseFeatures[hand]));
+		return true;
+	}
+
+	// For overlays drawn on the render thread, after beginFrame.
+	int getNumDisplayedHands() const                    { return m_frames[m_iDisplayed].snapshot.numHands; }
+	const PoseMatches& getDisplayedPoseMatches(int hand) const { return m_frames[m_iDisplayed].poseMatches[hand]; }
+
+	// GL state the scene relies on. Call once per new context.
+	void initGL()
+	{
+		glEnable(GL_BLEND);
+		glEnable(GL_TEXTURE_2D);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_BACK);
+		glFrontFace(GL_CCW);
+
+		glEnable(GL_DEPTH_TEST);
+		glDepthMask(true);
+		glDepthFunc(GL_LESS);
+
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
+		glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
+		glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+		glEnable(GL_COLOR_MATERIAL);
+		glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+		glShadeModel(GL_SMOOTH);
+
+		glEnable(GL_LIGHTING);
+
+		m_trails.initGL();
+		m_staticSceneRenderer.initGL();
+	}
+
+	// Call before the context goes away.
+	void releaseGL()
+	{
+		m_trails.releaseGL();
+		m_staticSceneRenderer.releaseGL();
+	}
+
+	// initGL for the lifetime of the guard, for scenes that live shorter than their
+	// context, so each one hands back its buffers and programs.
+	class ScopedGL
+	{
+	public:
+		explicit ScopedGL(HandScene& scene) : m_scene(scene)  { m_scene.initGL(); }
+		~ScopedGL()                                            { m_scene.releaseGL(); }
+
+	private:
+		HandScene& m_scene;
+
+		JUCE_DECLARE_NON_COPYABLE (ScopedGL)
+	};
+
+	// Affects model view matrix. (Needs to be inside a glPush/glPop matrix block)
+	void setupScene(LeapUtilGL::CameraGL& camera, int width, int height)
+	{
+		TRACE_SCOPE("setupScene");
+
+		OpenGLHelpers::clear (Colours::skyblue.withAlpha (1.0f));
+		camera.SetAspectRatio(width / static_cast<float>(height));
+
+		camera.SetupGLProjection();
+
+		camera.ResetGLView();
+
+		// left, high, near - corner light
+		LeapUtilGL::GLVector4fv vLight0Position(-3.0f, 3.0f, -3.0f, 1.0f);
+		// right, near - side light
+		LeapUtilGL::GLVector4fv vLight1Position(3.0f, 0.0f, -1.5f, 1.0f);
+		// near - head light
+		LeapUtilGL::GLVector4fv vLight2Position(0.0f, 0.0f,  -3.0f, 1.0f);
+
+		///Turns off the depth test every frame when calling paint.
+		glEnable(GL_DEPTH_TEST);
+		glDepthMask(true);
+		glDepthFunc(GL_LESS);
+
+		glEnable(GL_BLEND);
+		glEnable(GL_TEXTURE_2D);
+
+		glLightModelfv(GL_LIGHT_MODEL_AMBIENT, GLColor(Colours::darkgrey));
+
+		glLightfv(GL_LIGHT0, GL_POSITION, vLight0Position);
+		glLightfv(GL_LIGHT0, GL_DIFFUSE, GLColor(Colour(0.5f, 0.40f, 0.40f, 1.0f)));
+		glLightfv(GL_LIGHT0, GL_AMBIENT, GLColor(Colours::black));
+
+		glLightfv(GL_LIGHT1, GL_POSITION, vLight1Position);
+		glLightfv(GL_LIGHT1, GL_DIFFUSE, GLColor(Colour(0.0f, 0.0f, 0.25f, 1.0f)));
+		glLightfv(GL_LIGHT1, GL_AMBIENT, GLColor(Colours::black));
+
+		glLightfv(GL_LIGHT2, GL_POSITION, vLight2Position);
+		glLightfv(GL_LIGHT2, GL_DIFFUSE, GLColor(Colour(0.15f, 0.15f, 0.15f, 1.0f)));
+		glLightfv(GL_LIGHT2, GL_AMBIENT, GLColor(Colours::black));
+
+		glEnable(GL_LIGHT0);
+		//glEnable(GL_LIGHT1);
+		//glEnable(GL_LIGHT2);
+
+		camera.SetupGLView();
+	}
+
+	//==============================================================================
+	// Builds everything render() needs from a frame. Only one thread may update at a time.
+	void update(const FrameSnapshot& frame)
+	{
+		beginUpdate(frame);
+		endUpdate();
+	}
+
+	// Starts processing the frame on the job system and returns straight away,
+	// so the caller can render the previous frame in the meantime.
+	void beginUpdate(const FrameSnapshot& frame)
+	{
+		TRACE_SCOPE("beginUpdate");
+
+		m_updateLock.enter();
+		jassert(!m_bUpdateStarted);
+		m_bUpdateStarted = true;
+
+		ProcessedFrame& building = m_frames[m_iBuilding];
+		building.snapshot = frame;
+		building.bShowDemo = m_bShowDemo;
+
+		m_updateTransform = m_transform;
+		m_updateTransform.useStabilizedPos = m_useStabelizedPos;
+
+		if (frame.numHands > 0)
+			m_fHandY = m_updateTransform.toScene(frame.hands[frame.numHands - 1].palmPosition).y;
+
+		m_fShadowScale = getShadowScale(m_fHandY);
+
+		if (m_resetDemoRequested.compareAndSetBool(0, 1))
+			resetDemoBodies();
+
+		m_graph.start(m_jobSystem);
+	}
+
+	// Waits for the frame started by beginUpdate and makes it the one render() draws next.
+	void endUpdate()
+	{
+		jassert(m_bUpdateStarted);
+
+		{
+			TRACE_SCOPE("endUpdate");
+			m_graph.wait();
+		}
+
+		{
+			const SpinLock::ScopedLockType sl(m_swapLock);
+			std::swap(m_iBuilding, m_iReady);
+			m_bNewFrameReady = true;
+		}
+
+		m_bUpdateStarted = false;
+		m_updateLock.exit();
+	}
+
+	// Draws the latest processed frame with the shadows first. Expects setupScene to have been called.
+	void render(const LeapUtilGL::CameraGL& camera)
+	{
+		beginFrame();
+		renderView(camera);
+	}
+
+	// Picks the frame the next renderView calls draw. Call it once per repaint, so
+	// every view of the repaint shows the same frame.
+	void beginFrame()
+	{
+		const SpinLock::ScopedLockType sl(m_swapLock);
+
+		if (m_bNewFrameReady)
+		{
+			std::swap(m_iDisplayed, m_iReady);
+			m_bNewFrameReady = false;
+		}
+
+		m_trails.upload();
+	}
+
+	// Draws the frame picked by beginFrame as seen by camera, into the current viewport.
+	// Draw lists are shared by all views, only what the camera cannot see is skipped.
+	// Expects setupScene to have been called with the same camera.
+	void renderView(const LeapUtilGL::CameraGL& camera)
+	{
+		TRACE_SCOPE("render");
+
+		// Only the render thread touches the displayed frame, no lock needed.
+		const ProcessedFrame& frame = m_frames[m_iDisplayed];
+		const ViewFrustum frustum(camera);
+
+		m_background.submit(&frustum);
+
+		if (m_staticScene != nullptr)
+			m_staticSceneRenderer.draw(*m_staticScene, frustum);
+
+		for (int handCount = 0; handCount < frame.snapshot.numHands; ++handCount)
+			frame.handShadows[handCount].submit(&frustum);
+
+		glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		for (int handCount = 0; handCount < frame.snapshot.numHands; ++handCount)
+			frame.hands[handCount].submit(&frustum);
+
+		if (frame.bShowDemo)
+			frame.demo.submit(&frustum);
+
+		frame.touchedProps.submit(&frustum);
+
+		m_trails.draw();
+	}
+
+private:
+	enum { kNumProcessedFrames = 3 };
+
+	// Everything computed from one frame snapshot.
+	struct ProcessedFrame
+	{
+		ProcessedFrame() : bShowDemo(false) {}
+
+		FrameSnapshot snapshot;
+		HandSkeleton  skeletons[FrameSnapshot::kMaxHands];
+		DrawList      handShadows[FrameSnapshot::kMaxHands];
+		DrawList      hands[FrameSnapshot::kMaxHands];
+		bool          bShowDemo;
+		DrawList      demo;
+		DrawList      touchedProps;
+		float         poseFeatures[FrameSnapshot::kMaxHands][PoseFeatures::kNumFeatures];
+		PoseMatches   poseMatches[FrameSnapshot::kMaxHands];
+	};
+
+	// Calls one of the scene's build steps; slot is the hand the step works on.
+	class SceneJob : public Job
+	{
+	public:
+		typedef void (HandScene::*Step)(int slot);
+
+		SceneJob(HandScene& scene, Step step, int slot)
+			: m_scene(scene),
+			m_step(step),
+			m_slot(slot)
+		{}
+
+		void run()
+		{
+			(m_scene.*m_step)(m_slot);
+		}
+
+	private:
+		HandScene& m_scene;
+		Step       m_step;
+		int        m_slot;
+	};
+
+	// Shadows get bigger as the hand goes up.
+	static float getShadowScale(float handY)
+	{
+		float maxScale = 4.0f;
+		float minScale = 2.0f;
+
+		float maxH = 4;
+
+		float currH = handY / maxH;
+		if (currH > maxH)
+			currH = maxH;
+
+		return ((maxScale - minScale) * currH) + minScale;
+	}
+
+	// The sphere the demo always had, and a stack of blocks beside it.
+	void resetDemoBodies()
+	{
+		const float blockSize = 0.24f;
+
+		m_physics.clear();
+		// Resting on the floor, at the size it is drawn.
+		m_physics.addSphere(Leap::Vector(m_vSphereInitialPos.x, m_fShadowsYPos + m_fSphereRadius / 2, m_vSphereInitialPos.z),
+			m_fSphereRadius / 2);
+
+		for (int i = 0; i < 3; ++i)
+			m_physics.addBox(Leap::Vector(-0.7f, m_fShadowsYPos + blockSize * (i + 0.5f), -0.6f),
+				Leap::Vector(blockSize, blockSize, blockSize) / 2);
+	}
+
+	void buildBackground()
+	{
+		m_background.clear();
+		m_background.addBox(createScaledTransform(Leap::Vector(0, m_fShadowsYPos + -0.05f, 0), 40, 0.01f, 40),
+			GLColor(0.15f, 0.15f, 0.1f));
+	}
+
+	//==============================================================================
+	// Job steps, run on the job system for the frame being built.
+	void buildSkeleton(int slot)
+	{
+		ProcessedFrame& frame = m_frames[m_iBuilding];
+
+		if (slot >= frame.snapshot.numHands)
+			return;
+
+		TRACE_SCOPE("buildSkeleton");
+		buildHandSkeleton(frame.snapshot.hands[slot], m_updateTransform, frame.skeletons[slot]);
+	}
+
+	void buildHandDrawLists(int slot)
+	{
+		ProcessedFrame& frame = m_frames[m_iBuilding];
+		DrawList& shadow = frame.handShadows[slot];
+		DrawList& hand = frame.hands[slot];
+
+		shadow.clear();
+		hand.clear();
+
+		if (slot >= frame.snapshot.numHands)
+			return;
+
+		TRACE_SCOPE("drawHands");
+
+		const HandSkeleton& skeleton = frame.skeletons[slot];
+		const float frameScale = m_updateTransform.frameScale;
+
+		// Flattened onto the floor.
+		const Leap::Matrix shadowMatrix(createScaledTransform(Leap::Vector(0, m_fShadowsYPos, 0), m_fShadowScale, 0.001f, m_fShadowScale));
+		const GLColor shadowColor(0, 0, 0, 0.2f);
+
+		const GLColor boneColor(0.0f, 0.0f, 0.0f);
+		const GLColor jointColor(0.0f, 0.2f, 1.0f);
+		const GLColor outlineColor(1, 0, 1, 0.5f);
+		const GLColor wristColor(0.1f, 0.1f, 1.0f);
+
+		for (int fingerCount = 0; fingerCount < skeleton.numFingers; ++fingerCount)
+		{
+			const FingerSkeleton& finger = skeleton.fingers[fingerCount];
+
+			for (int i = 0; i < finger.numJoints; ++i)
+			{
+				const Leap::Vector& prevPos = finger.joints[i];
+				const Leap::Vector& jointPos = finger.joints[i+1];
+
+				//Finger bone
+				hand.addLine(prevPos, jointPos, boneColor);
+
+				//joint
+				hand.addSphere(createScaledTransform(jointPos, 3.0f * frameScale, 3.0f * frameScale, 3.0f * frameScale), jointColor);
+
+				//Joint outline
+				//Use the hand normal to create a new lookat for the finger and use the direction as z
+				const Leap::Matrix outline = createTransform(finger.boneDirections[i], (prevPos + jointPos) / 2)
+					* createScaledTransform(Leap::Vector::zero(), 0.075f, 0.075f, finger.boneLength);
+
+				hand.addBox(outline, outlineColor, true);
+				shadow.addBox(shadowMatrix * outline, shadowColor, true);
+			}
+
+			//knuckle bone to wrist
+			hand.addLine(skeleton.wristPosition, finger.joints[finger.numJoints], outlineColor);
+		}
+
+		//HAND
+		{
+			// Approximation, the hand size is the size of the sphere we can handle minus the size of the biggest finger
+			float handSize = 50;//hand.sphereRadius() - hand.fingers().frontmost().length();
+
+			// The palm used to be drawn in whatever colour was current: the finger outline,
+			// or what the previous hand (or the shadow pass, for the first one) left behind.
+			GLColor palmColor(outlineColor);
+
+			if (skeleton.numFingers == 0)
+				palmColor = slot == 0 ? shadowColor : wristColor;
+
+			//hand centre
+			const Leap::Matrix palm = skeleton.palmTransform
+				* createScaledTransform(Leap::Vector::zero(), frameScale * 4, frameScale * 4, frameScale * 4);
+
+			hand.addSphere(palm, palmColor);
+			shadow.addSphere(shadowMatrix * palm, shadowColor, true);
+
+			//hand outline
+			const Leap::Matrix palmOutline = skeleton.palmTransform
+				* createScaledTransform(Leap::Vector::zero(), handSize * 0.75f * frameScale, 0.15f, handSize * 0.75f * frameScale);
+
+			hand.addSphere(palmOutline, outlineColor, true);
+			shadow.addSphere(shadowMatrix * palmOutline, shadowColor, true);
+		}
+
+		//wrist
+		hand.addSphere(createScaledTransform(skeleton.wristPosition, frameScale * 4, frameScale * 4, frameScale * 4), wristColor);
+
+		//wrist to the center of the hand
+		hand.addLine(skeleton.wristPosition, skeleton.palmPosition, wristColor);
+	}
+
+	void updateDemo(int)
+	{
+		const ProcessedFrame& frame = m_frames[m_iBuilding];
+
+		if (!frame.bShowDemo)
+			return;
+
+		TRACE_SCOPE("updateDemo");
+
+		// Fingers and palm the size drawHands draws them.
+		const float frameScale = m_updateTransform.frameScale;
+		m_physics.update(frame.snapshot, frame.skeletons, 5.0f * frameScale,
+			Leap::Vector(18.75f * frameScale, 5.0f * frameScale, 18.75f * frameScale));
+	}
+
+	void addTrailSegments(int)
+	{
+		TRACE_SCOPE("addTrailSegments");
+
+		m_trails.addFrame(m_frames[m_iBuilding].snapshot, m_updateTransform);
+	}
+
+	void matchPose(int slot)
+	{
+		ProcessedFrame& frame = m_frames[m_iBuilding];
+		PoseMatches& matches = frame.poseMatches[slot];
+		matches.numMatches = 0;
+
+		if (slot >= frame.snapshot.numHands)
+			return;
+
+		TRACE_SCOPE("matchPose");
+
+		PoseFeatures::extract(frame.snapshot.hands[slot], frame.poseFeatures[slot]);
+
+		if (m_poseLibrary != nullptr)
+			m_poseLibrary->findNearest(frame.poseFeatures[slot], matches);
+	}
+
+	// Outlines the static props within reach of a fingertip.
+	void findTouchedProps(int)
+	{
+		ProcessedFrame& frame = m_frames[m_iBuilding];
+		frame.touchedProps.clear();
+
+		if (m_staticScene == nullptr)
+			return;
+
+		TRACE_SCOPE("findTouchedProps");
+
+		const float tipRadius = m_fTipRadius * m_updateTransform.frameScale;
+		m_touchedProps.clearQuick();
+
+		for (int handCount = 0; handCount < frame.snapshot.numHands; ++handCount)
+		{
+			const HandSnapshot& hand = frame.snapshot.hands[handCount];
+
+			for (int fingerCount = 0; fingerCount < hand.numFingers; ++fingerCount)
+			{
+				const FingerSnapshot& finger = hand.fingers[fingerCount];
+				const Leap::Vector tipPos = m_updateTransform.toScene(m_updateTransform.useStabilizedPos
+					? finger.stabilizedTipPosition : finger.tipPosition);
+
+				m_staticScene->findPropsNear(tipPos, tipRadius, m_nearProps);
+
+				for (int i = 0; i < m_nearProps.size(); ++i)
+					m_touchedProps.addIfNotAlreadyThere(m_nearProps.getUnchecked(i));
+			}
+		}
+
+		const GLColor touchedColor(1.0f, 0.8f, 0.0f, 0.6f);
+
+		for (int i = 0; i < m_touchedProps.size(); ++i)
+		{
+			const StaticSceneFormat::Prop& prop = m_staticScene->getProp(m_touchedProps.getUnchecked(i));
+			const Leap::Matrix transform(Leap::Vector(prop.transform[0], prop.transform[1], prop.transform[2]) * 1.05f,
+				Leap::Vector(prop.transform[4], prop.transform[5], prop.transform[6]) * 1.05f,
+				Leap::Vector(prop.transform[8], prop.transform[9], prop.transform[10]) * 1.05f,
+				Leap::Vector(prop.transform[12], prop.transform[13], prop.transform[14]));
+
+			if (prop.shape == StaticSceneFormat::kShape_Sphere)
+				frame.touchedProps.addSphere(transform, touchedColor, true);
+			else
+				frame.touchedProps.addBox(transform, touchedColor, true);
+		}
+	}
+
+	void buildDemoDrawList(int)
+	{
+		TRACE_SCOPE("buildDemoDrawList");
+
+		fillDemoDrawList(m_frames[m_iBuilding]);
+	}
+
+	void fillDemoDrawList(ProcessedFrame& frame)
+	{
+		frame.demo.clear();
+
+		if (!frame.bShowDemo)
+			return;
+
+		for (int i = 0; i < m_physics.getNumBodies(); ++i)
+		{
+			const ContactSolver::Body& body = m_physics.getBody(i);
+			const float shadowSize = body.radius * 2.4f;
+
+			// shadow
+			frame.demo.addSphere(createScaledTransform(Leap::Vector(body.position.x, m_fShadowsYPos, body.position.z),
+				shadowSize, shadowSize * 0.001f, shadowSize), GLColor(0, 0, 0, 0.2f), true);
+
+			if (body.shape == ContactSolver::kShape_Sphere)
+				frame.demo.addSphere(m_physics.getBodyTransform(i), GLColor(0.3f, 0.6f, 0.1f));
+			else
+				frame.demo.addBox(m_physics.getBodyTransform(i), GLColor(0.8f, 0.45f, 0.15f));
+		}
+	}
+
+	SceneTransform              m_transform;
+	float                       m_fTipRadius;
+	bool                        m_useStabelizedPos;
+	bool                        m_bShowDemo;
+
+	Leap::Vector                m_vSphereInitialPos;
+	ContactSolver               m_physics;
+	float                       m_fSphereRadius;
+	float                       m_fShadowsYPos;
+	Atomic<int>                 m_resetDemoRequested;
+
+	DrawList                    m_background;
+	FingerTrails                m_trails;
+	ScopedPointer<PoseLibrary>  m_poseLibrary;
+	ScopedPointer<StaticScene>  m_staticScene;
+	StaticSceneRenderer         m_staticSceneRenderer;
+	Array<int>                  m_nearProps;
+	Array<int>                  m_touchedProps;
+
+	// Inputs of the update in flight, fixed by beginUpdate.
+	SceneTransform              m_updateTransform;
+	float                       m_fHandY;
+	float                       m_fShadowScale;
+	CriticalSection             m_updateLock;
+	bool                        m_bUpdateStarted;
+
+	// Building belongs to the updating thread, displayed to the render thread.
+	ProcessedFrame              m_frames[kNumProcessedFrames];
+	int                         m_iBuilding;
+	int                         m_iReady;
+	int                         m_iDisplayed;
+	bool                        m_bNewFrameReady;
+	SpinLock                    m_swapLock;
+
+	JobSystem&                  m_jobSystem;
+	OwnedArray<SceneJob>        m_jobs;
+	JobGraph                    m_graph;
+};
+
+#endif // VIRTUALHANDS_HANDSCENE_H
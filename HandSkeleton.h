@@ -0,0 +1,118 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_HANDSKELETON_H
+#define VIRTUALHANDS_HANDSKELETON_H
+
+#include "HandSnapshot.h"
+
+inline Leap::Matrix createTransform(const Leap::Vector& forwardVec, const Leap::Vector& translation)
+{
+	//OpenGl Look at
+	Leap::Vector z(-forwardVec);
+	Leap::Vector y(0,1,0);
+	Leap::Vector x(0,0,0);
+
+	x = y.cross(z);
+	y = z.cross(x);
+
+	return Leap::Matrix(x, y, z, translation);
+}
+
+// Translation followed by a scale along each axis, like glTranslatef then glScalef.
+inline Leap::Matrix createScaledTransform(const Leap::Vector& translation, float sx, float sy, float sz)
+{
+	return Leap::Matrix(Leap::Vector(sx, 0, 0), Leap::Vector(0, sy, 0), Leap::Vector(0, 0, sz), translation);
+}
+
+//==============================================================================
+// Scene space positions of the fake finger joints. Leap motion does not detect
+// joints, we fake them by splitting the finger from the tip towards the wrist
+// and assuming the last joint never moves.
+struct FingerSkeleton
+{
+	enum { kMaxJoints = 3 };
+
+	int          numJoints;                    // thumb has only 2 joints.
+	float        boneLength;                   // in scene units, the same for every bone
+	Leap::Vector joints[kMaxJoints + 1];       // joints[0] is the tip, the last one the knuckle
+	Leap::Vector boneDirections[kMaxJoints];   // from joints[i] towards joints[i+1]
+};
+
+struct HandSkeleton
+{
+	Leap::Vector   palmPosition;
+	Leap::Vector   wristPosition;
+	Leap::Matrix   palmTransform;              // hand centre, rotated to the hand direction and normal
+	int            numFingers;
+	FingerSkeleton fingers[HandSnapshot::kMaxFingers];
+};
+
+//==============================================================================
+// How Leap coordinates (millimetres above the device) map into the scene.
+struct SceneTransform
+{
+	SceneTransform()
+		: frameScale(0.0075f),
+		useStabilizedPos(false)
+	{
+		frameTransform.origin = Leap::Vector(0.0f, -2.0f, 0.5f);
+	}
+
+	Leap::Vector toScene(const Leap::Vector& leapPosition) const
+	{
+		return frameTransform.transformPoint(leapPosition * frameScale);
+	}
+
+	Leap::Matrix frameTransform;
+	float        frameScale;
+	bool         useStabilizedPos;
+};
+
+inline void buildHandSkeleton(const HandSnapshot& hand, const SceneTransform& transform, HandSkeleton& skeleton)
+{
+	const float frameScale = transform.frameScale;
+
+	skeleton.palmPosition  = transform.toScene(hand.palmPosition);
+	skeleton.wristPosition = skeleton.palmPosition + (-hand.direction * (hand.sphereRadius / 2.0f) * frameScale);
+
+	// Same rotations drawHands used to apply with glRotatef, in the same order.
+	skeleton.palmTransform = Leap::Matrix(Leap::Vector::yAxis(), -hand.direction.yaw(), skeleton.palmPosition)
+		* Leap::Matrix(Leap::Vector::xAxis(), hand.direction.pitch())
+		* Leap::Matrix(Leap::Vector::zAxis(), hand.palmNormal.roll());
+
+	skeleton.numFingers = hand.numFingers;
+
+	for (int fingerCount = 0; fingerCount < hand.numFingers; ++fingerCount)
+	{
+		const FingerSnapshot& finger = hand.fingers[fingerCount];
+		FingerSkeleton& fingerSkeleton = skeleton.fingers[fingerCount];
+
+		const Leap::Vector tipPos = transform.useStabilizedPos ? finger.stabilizedTipPosition : finger.tipPosition;
+		const Leap::Vector vFingerDir = -transform.frameTransform.transformDirection(finger.direction); //negative because we want to know the opposite direction to draw the bones
+
+		fingerSkeleton.numJoints = hand.thumbId == finger.id ? 2 : 3;
+		fingerSkeleton.boneLength = finger.length / (float)fingerSkeleton.numJoints * frameScale;
+		fingerSkeleton.joints[0] = transform.toScene(tipPos);
+
+		for (int i = 0; i < fingerSkeleton.numJoints; ++i)
+		{
+			const Leap::Vector& prevPos = fingerSkeleton.joints[i];
+			Leap::Vector desiredDir;
+
+			if (i+1 == fingerSkeleton.numJoints) //last joint
+				desiredDir = (skeleton.wristPosition - prevPos).normalized();
+			else
+				desiredDir = vFingerDir;
+
+			fingerSkeleton.boneDirections[i] = desiredDir;
+			fingerSkeleton.joints[i+1] = prevPos + desiredDir * fingerSkeleton.boneLength;
+		}
+	}
+}
+
+#endif // VIRTUALHANDS_HANDSKELETON_H
@@ -0,0 +1,110 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_HANDSNAPSHOT_H
+#define VIRTUALHANDS_HANDSNAPSHOT_H
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "Leap.h"
+
+//==============================================================================
+// Plain copies of the parts of a Leap::Frame the scene uses.
+// A Leap::Frame can only be obtained from a live controller, so everything
+// downstream of the listener (drawing, recording, replay) works on these instead.
+struct FingerSnapshot
+{
+	FingerSnapshot() : id(0), length(0) {}
+
+	int32        id;
+	float        length;
+	Leap::Vector tipPosition;
+	Leap::Vector stabilizedTipPosition;
+	Leap::Vector tipVelocity;
+	Leap::Vector direction;
+};
+
+struct HandSnapshot
+{
+	enum { kMaxFingers = 5 };
+
+	HandSnapshot() : id(0), thumbId(0), sphereRadius(0), numFingers(0) {}
+
+	int32          id;
+	int32          thumbId; // finger we assume is the thumb, see extractSnapshot
+	float          sphereRadius;
+	Leap::Vector   palmPosition;
+	Leap::Vector   palmNormal;
+	Leap::Vector   direction;
+	int32          numFingers;
+	FingerSnapshot fingers[kMaxFingers];
+};
+
+struct FrameSnapshot
+{
+	enum { kMaxHands = 4 };
+
+	FrameSnapshot() : id(0), timestamp(0), numHands(0) {}
+
+	int64        id;
+	int64        timestamp; // microseconds, Leap device clock
+	int32        numHands;
+	HandSnapshot hands[kMaxHands];
+};
+
+//==============================================================================
+inline void extractSnapshot(const Leap::Frame& frame, FrameSnapshot& snapshot)
+{
+	const Leap::HandList hands = frame.hands();
+
+	snapshot.id        = frame.id();
+	snapshot.timestamp = frame.timestamp();
+	snapshot.numHands  = jmin(hands.count(), (int)FrameSnapshot::kMaxHands);
+
+	for (int handCount = 0; handCount < snapshot.numHands; ++handCount)
+	{
+		const Leap::Hand hand = hands[handCount];
+		const Leap::FingerList fingers = hand.fingers();
+		HandSnapshot& handSnapshot = snapshot.hands[handCount];
+
+		handSnapshot.id           = hand.id();
+		handSnapshot.sphereRadius = hand.sphereRadius();
+		handSnapshot.palmPosition = hand.palmPosition();
+		handSnapshot.palmNormal   = hand.palmNormal();
+		handSnapshot.direction    = hand.direction();
+
+		/*
+		Note that the the leftmost() and rightmost() functions only identify which hand is farthest to the left or to the right.
+		The functions do not identify which hand is the right or the left hand.
+		*/
+		//Leap does not know which hand is which... lets assume their relative position
+		handSnapshot.thumbId = 0;
+		if (hands.count() == 2)
+		{
+			if (hand.id() == hands.leftmost().id())
+				handSnapshot.thumbId = fingers.rightmost().id();
+			else
+				handSnapshot.thumbId = fingers.leftmost().id();
+		}
+
+		handSnapshot.numFingers = jmin(fingers.count(), (int)HandSnapshot::kMaxFingers);
+
+		for (int fingerCount = 0; fingerCount < handSnapshot.numFingers; ++fingerCount)
+		{
+			const Leap::Finger finger = fingers[fingerCount];
+			FingerSnapshot& fingerSnapshot = handSnapshot.fingers[fingerCount];
+
+			fingerSnapshot.id                    = finger.id();
+			fingerSnapshot.length                = finger.length();
+			fingerSnapshot.tipPosition           = finger.tipPosition();
+			fingerSnapshot.stabilizedTipPosition = finger.stabilizedTipPosition();
+			fingerSnapshot.tipVelocity           = finger.tipVelocity();
+			fingerSnapshot.direction             = finger.direction();
+		}
+	}
+}
+
+#endif // VIRTUALHANDS_HANDSNAPSHOT_H
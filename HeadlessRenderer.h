@@ -0,0 +1,450 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_HEADLESSRENDERER_H
+#define VIRTUALHANDS_HEADLESSRENDERER_H
+
+#include "HandScene.h"
+#include "SessionFile.h"
+#include "FrameEncoder.h"
+
+// Headless rendering needs EGL with surfaceless contexts (Mesa, llvmpipe included).
+#ifndef VIRTUALHANDS_HEADLESS
+ #define VIRTUALHANDS_HEADLESS JUCE_LINUX
+#endif
+
+#if VIRTUALHANDS_HEADLESS
+ #include <EGL/egl.h>
+ #include <EGL/eglext.h>
+#endif
+
+//==============================================================================
+struct HeadlessSettings
+{
+	HeadlessSettings()
+		: format(FrameEncoder::kFormat_PNG),
+		width(1024),
+		height(768),
+		fps(60),
+		numEncoderThreads(jmax(1, SystemStats::getNumCpus() - 1)),
+		maxFrames(0),
+		bDropFrames(false)
+	{}
+
+	File                 replayFile;
+	File                 output;             // directory for PNG, file for Y4M; none to only measure
+	FrameEncoder::Format format;
+	int                  width;
+	int                  height;
+	int                  fps;
+	int                  numEncoderThreads;
+	int64                maxFrames;          // 0 renders until the recording ends
+	bool                 bDropFrames;        // drop frames the encoders can't keep up with
+};
+
+#if VIRTUALHANDS_HEADLESS
+
+//==============================================================================
+// A GL context with no window or surface at all. Everything is drawn into an FBO.
+class OffscreenGLContext
+{
+public:
+	OffscreenGLContext()
+		: m_display(EGL_NO_DISPLAY),
+		m_context(EGL_NO_CONTEXT)
+	{}
+
+	~OffscreenGLContext()
+	{
+		release();
+	}
+
+	bool create()
+	{
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay
+			= (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+		if (getPlatformDisplay != nullptr)
+			m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+
+		if (m_display == EGL_NO_DISPLAY)
+			m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		if (m_display == EGL_NO_DISPLAY || ! eglInitialize(m_display, nullptr, nullptr))
+			return false;
+
+		// The scene is drawn with the fixed function pipeline, so we need desktop GL rather than GLES.
+		if (! eglBindAPI(EGL_OPENGL_API))
+			return false;
+
+		const EGLint configAttribs[] =
+		{
+			EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE,        8,
+			EGL_GREEN_SIZE,      8,
+			EGL_BLUE_SIZE,       8,
+			EGL_ALPHA_SIZE,      8,
+			EGL_DEPTH_SIZE,      24,
+			EGL_NONE
+		};
+
+		EGLConfig config;
+		EGLint numConfigs = 0;
+
+		if (! eglChooseConfig(m_display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+			return false;
+
+		m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, nullptr);
+
+		if (m_context == EGL_NO_CONTEXT)
+			return false;
+
+		return eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context) == EGL_TRUE;
+	}
+
+	void release()
+	{
+		if (m_display != EGL_NO_DISPLAY)
+		{
+			eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+			if (m_context != EGL_NO_CONTEXT)
+				eglDestroyContext(m_display, m_context);
+
+			eglTerminate(m_display);
+		}
+
+		m_display = EGL_NO_DISPLAY;
+		m_context = EGL_NO_CONTEXT;
+	}
+
+private:
+	EGLDisplay m_display;
+	EGLContext m_context;
+};
+
+//==============================================================================
+class OffscreenFramebuffer
+{
+public:
+	OffscreenFramebuffer()
+		: m_framebuffer(0)
+	{
+		m_renderbuffers[0] = m_renderbuffers[1] = 0;
+	}
+
+	~OffscreenFramebuffer()
+	{
+		release();
+	}
+
+	bool create(int width, int height)
+	{
+		glGenRenderbuffers(2, m_renderbuffers);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[0]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[1]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &m_framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_renderbuffers[0]);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_renderbuffers[1]);
+
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+		return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	}
+
+	void release()
+	{
+		if (m_framebuffer != 0)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glDeleteFramebuffers(1, &m_framebuffer);
+			glDeleteRenderbuffers(2, m_renderbuffers);
+		}
+
+		m_framebuffer = 0;
+		m_renderbuffers[0] = m_renderbuffers[1] = 0;
+	}
+
+private:
+	GLuint m_framebuffer;
+	GLuint m_renderbuffers[2];
+};
+
+//==============================================================================
+// Copies finished frames out of the framebuffer without stalling on the GPU.
+// glReadPixels goes into one of two pixel buffers; the other one, filled a frame
+// earlier, is mapped and handed to the encoder. By then the GPU is normally done
+// with it. The encoder's frame pool is bounded, so when encoding falls behind,
+// rendering is throttled to the encoders, or frames are dropped if bDropFrames is set.
+class FrameReadback
+{
+public:
+	enum { kNumPixelBuffers = 2 };
+
+	FrameReadback(FrameEncoder* encoder, int width, int height)
+		: m_encoder(encoder),
+		m_width(width),
+		m_height(height),
+		m_nextBuffer(0)
+	{
+		glGenBuffers(kNumPixelBuffers, m_pixelBuffers);
+
+		for (int i = 0; i < kNumPixelBuffers; ++i)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pixelBuffers[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, getFrameSize(), nullptr, GL_STREAM_READ);
+			m_fences[i] = 0;
+			m_frameIndices[i] = 0;
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	~FrameReadback()
+	{
+		flush();
+		glDeleteBuffers(kNumPixelBuffers, m_pixelBuffers);
+	}
+
+	// Starts reading back the current framebuffer and passes on the previous frame.
+	void queueFrame(int64 frameIndex)
+	{
+		TRACE_SCOPE("queueFrame");
+
+		const int buffer = m_nextBuffer;
+		m_nextBuffer = (m_nextBuffer + 1) % kNumPixelBuffers;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pixelBuffers[buffer]);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, m_width, m_height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		m_fences[buffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_frameIndices[buffer] = frameIndex;
+
+		collect(m_nextBuffer);
+	}
+
+	// Collects every outstanding frame, oldest first.
+	void flush()
+	{
+		for (int i = 0; i < kNumPixelBuffers; ++i)
+			collect((m_nextBuffer + i) % kNumPixelBuffers);
+	}
+
+private:
+	GLsizeiptr getFrameSize() const { return (GLsizeiptr) m_width * m_height * 4; }
+
+	void collect(int buffer)
+	{
+		if (m_fences[buffer] == 0)
+			return;
+
+		while (glClientWaitSync(m_fences[buffer], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+
+		glDeleteSync(m_fences[buffer]);
+		m_fences[buffer] = 0;
+
+		if (m_encoder == nullptr)
+			return;
+
+		// Taken before mapping, so the buffer is never held mapped while waiting on the encoders.
+		CapturedFrame* frame = m_encoder->acquireFrame(m_frameIndices[buffer]);
+
+		if (frame == nullptr)
+			return;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pixelBuffers[buffer]);
+
+		if (const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, getFrameSize(), GL_MAP_READ_BIT))
+		{
+			memcpy(frame->pixels, pixels, (size_t) getFrameSize());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+			m_encoder->submitFrame(frame);
+		}
+		else
+		{
+			m_encoder->discardFrame(frame);
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	FrameEncoder* m_encoder;
+	int           m_width;
+	int           m_height;
+	int           m_nextBuffer;
+	GLuint        m_pixelBuffers[kNumPixelBuffers];
+	GLsync        m_fences[kNumPixelBuffers];
+	int64         m_frameIndices[kNumPixelBuffers];
+};
+
+//==============================================================================
+// Renders a recorded session into an offscreen framebuffer at a fixed timestep,
+// as fast as the GPU allows, optionally writing every frame out as PNG or Y4M.
+class HeadlessRenderer : public Thread
+{
+public:
+	explicit HeadlessRenderer(const HeadlessSettings& settings)
+		: Thread("HeadlessRenderer"),
+		m_settings(settings),
+		m_bSucceeded(false)
+	{}
+
+	~HeadlessRenderer()
+	{
+		stopThread(10000);
+	}
+
+	bool succeeded() const { return m_bSucceeded; }
+
+	void run()
+	{
+		m_bSucceeded = render();
+
+		JUCEApplication::quit();
+	}
+
+private:
+	bool render()
+	{
+		OffscreenGLContext context;
+
+		if (! context.create())
+			return fail("Could not create a surfaceless EGL context");
+
+		if (! initGLExtensions())
+			return fail("Framebuffer objects, pixel buffers and sync objects are required");
+
+		SessionReader replay(m_settings.replayFile);
+
+		if (! replay.isValid())
+			return fail("Could not read session " + m_settings.replayFile.getFullPathName());
+
+		ScopedPointer<FrameEncoder> encoder;
+
+		if (m_settings.output != File::nonexistent)
+		{
+			encoder = new FrameEncoder(m_settings.output, m_settings.format,
+				m_settings.width, m_settings.height, m_settings.fps, m_settings.numEncoderThreads, m_settings.bDropFrames);
+
+			if (! encoder->isOpen())
+				return fail("Could not open " + m_settings.output.getFullPathName());
+		}
+
+		OffscreenFramebuffer framebuffer;
+
+		if (! framebuffer.create(m_settings.width, m_settings.height))
+			return fail("Could not create the offscreen framebuffer");
+
+		glViewport(0, 0, m_settings.width, m_settings.height);
+
+		HandScene scene;
+		const HandScene::ScopedGL sceneGL(scene);
+
+		LeapUtilGL::CameraGL camera;
+		camera.SetOrbitTarget(Leap::Vector::zero());
+		camera.SetPOVLookAt(Leap::Vector(0, 6, 10), camera.GetOrbitTarget());
+
+		FrameSnapshot frame;
+		int64 numFrames = 0;
+		const int64 startTicks = Time::getHighResolutionTicks();
+
+		bool bFinished = ! replay.advanceTo(0, frame) && replay.isFinished();
+
+		if (! bFinished)
+			scene.update(frame);
+
+		{
+			FrameReadback readback(encoder, m_settings.width, m_settings.height);
+
+			while (! bFinished && ! threadShouldExit())
+			{
+				if (m_settings.maxFrames > 0 && numFrames >= m_settings.maxFrames)
+					break;
+
+				TRACE_SCOPE("headlessFrame");
+
+				// The workers build the next frame while this thread submits the current one.
+				const int64 nextSessionTime = (numFrames + 1) * 1000000 / m_settings.fps;
+
+				bFinished = ! replay.advanceTo(nextSessionTime, frame) && replay.isFinished();
+
+				if (! bFinished)
+					scene.beginUpdate(frame);
+
+				scene.setupScene(camera, m_settings.width, m_settings.height);
+				scene.render(camera);
+
+				readback.queueFrame(numFrames++);
+
+				if (! bFinished)
+					scene.endUpdate();
+			}
+		}
+
+		const double renderSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks);
+
+		if (encoder != nullptr)
+			encoder->finish();
+
+		const double totalSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks);
+
+		Logger::writeToLog(String::formatted("Rendered %d frames in %.2fs (%.1f fps), %.2fs including encoding",
+			(int) numFrames, renderSeconds, renderSeconds > 0 ? numFrames / renderSeconds : 0.0, totalSeconds));
+
+		if (encoder != nullptr)
+			Logger::writeToLog(String::formatted("Encoder used %d frame buffers, dropped %d frames",
+				encoder->getNumFrameBuffers(), (int) encoder->getNumDroppedFrames()));
+
+		return true;
+	}
+
+public:
+	// Also used by the replay harness, which renders through the same offscreen path.
+	static bool initGLExtensions()
+	{
+		glewExperimental = GL_TRUE;
+		GLenum err = glewInit();
+
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+		// GLEW built for GLX refuses surfaceless contexts, but can still load the entry points.
+		if (err == GLEW_ERROR_NO_GLX_DISPLAY)
+			err = glewContextInit();
+#endif
+
+		return err == GLEW_OK
+			&& glGenFramebuffers != nullptr
+			&& glMapBufferRange != nullptr
+			&& glFenceSync != nullptr;
+	}
+
+private:
+	static bool fail(const String& message)
+	{
+		Logger::writeToLog("Headless rendering failed: " + message);
+		return false;
+	}
+
+	HeadlessSettings m_settings;
+	bool             m_bSucceeded;
+};
+
+#endif // VIRTUALHANDS_HEADLESS
+
+#endif // VIRTUALHANDS_HEADLESSRENDERER_H
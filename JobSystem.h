@@ -0,0 +1,291 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_JOBSYSTEM_H
+#define VIRTUALHANDS_JOBSYSTEM_H
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+class JobGraph;
+class JobSystem;
+
+//==============================================================================
+// A unit of per-frame work. Jobs are long lived: they are added to a JobGraph
+// once and run again every time the graph is started.
+class Job
+{
+public:
+	Job()
+		: m_numDependencies(0),
+		m_pGraph(nullptr)
+	{}
+
+	virtual ~Job() {}
+
+	virtual void run() = 0;
+
+	// This job will not start before other has finished. Both must be in the same graph.
+	void runsAfter(Job& other)
+	{
+		other.m_successors.add(this);
+		++m_numDependencies;
+	}
+
+private:
+	friend class JobGraph;
+	friend class JobSystem;
+
+	Array<Job*> m_successors;
+	int         m_numDependencies;
+	Atomic<int> m_numPending;
+	JobGraph*   m_pGraph;
+
+	JUCE_DECLARE_NON_COPYABLE (Job)
+};
+
+//==============================================================================
+// A fixed set of jobs and their dependencies, started once per frame.
+class JobGraph
+{
+public:
+	JobGraph()
+		: m_pJobSystem(nullptr),
+		m_finished(true)
+	{}
+
+	void add(Job& job)
+	{
+		job.m_pGraph = this;
+		m_jobs.add(&job);
+	}
+
+	// Queues every job without dependencies and returns straight away.
+	inline void start(JobSystem& jobSystem);
+
+	// Returns once every job has run, running queued jobs on this thread in the meantime.
+	inline void wait();
+
+	void run(JobSystem& jobSystem)
+	{
+		start(jobSystem);
+		wait();
+	}
+
+private:
+	friend class JobSystem;
+
+	void jobFinished()
+	{
+		if (--m_numUnfinished == 0)
+			m_finished.signal();
+	}
+
+	Array<Job*>   m_jobs;
+	Atomic<int>   m_numUnfinished;
+	JobSystem*    m_pJobSystem;
+	WaitableEvent m_finished;
+};
+
+//==============================================================================
+// Runs jobs on a fixed set of worker threads. Every worker has its own queue and
+// takes its newest job first; idle workers steal the oldest job from the others.
+// Threads outside the system queue into a shared queue and help out while they wait.
+class JobSystem
+{
+public:
+	explicit JobSystem(int numWorkers)
+		: m_workAvailable(false)
+	{
+		for (int i = 0; i <= numWorkers; ++i)
+			m_queues.add(new WorkQueue());
+
+		for (int i = 0; i < numWorkers; ++i)
+		{
+			Worker* pWorker = m_workers.add(new Worker(*this, i));
+			pWorker->startThread();
+		}
+	}
+
+	~JobSystem()
+	{
+		for (int i = 0; i < m_workers.size(); ++i)
+			m_workers[i]->signalThreadShouldExit();
+
+		// Each worker passes this on as it exits.
+		m_workAvailable.signal();
+		m_workers.clear();
+	}
+
+	int getNumWorkers() const { return m_workers.size(); }
+
+	// Shared by all scenes; one worker per core besides the thread that submits.
+	static JobSystem& getSharedInstance()
+	{
+		static JobSystem s_jobSystem(jmax(1, SystemStats::getNumCpus() - 1));
+
+		return s_jobSystem;
+	}
+
+	void submit(Job* pJob)
+	{
+		WorkQueue& queue = *m_queues.getUnchecked(getQueueIndex());
+
+		{
+			const SpinLock::ScopedLockType sl(queue.lock);
+			queue.jobs.add(pJob);
+		}
+
+		++m_numQueued;
+		m_workAvailable.signal();
+	}
+
+	// Runs one queued job on the calling thread. Returns false if there was none.
+	bool runOneJob()
+	{
+		Job* pJob = takeJob(getQueueIndex());
+
+		if (pJob == nullptr)
+			return false;
+
+		execute(pJob);
+		return true;
+	}
+
+private:
+	struct WorkQueue
+	{
+		SpinLock    lock;
+		Array<Job*> jobs;
+	};
+
+	class Worker : public Thread
+	{
+	public:
+		Worker(JobSystem& owner, int index)
+			: Thread("JobSystem worker"),
+			m_owner(owner),
+			m_index(index)
+		{}
+
+		~Worker()
+		{
+			stopThread(1000);
+		}
+
+		void run()
+		{
+			m_owner.m_queueIndex.get() = m_index + 1;
+
+			while (!threadShouldExit())
+			{
+				if (!m_owner.runOneJob())
+					m_owner.m_workAvailable.wait(-1);
+			}
+
+			m_owner.m_workAvailable.signal();
+		}
+
+	private:
+		JobSystem& m_owner;
+		int        m_index;
+	};
+
+	// Workers use their own queue, every other thread the shared one at the end.
+	int getQueueIndex() const
+	{
+		const int index = m_queueIndex.get() - 1;
+		return index >= 0 ? index : m_queues.size() - 1;
+	}
+
+	Job* takeJob(int ownIndex)
+	{
+		const int numQueues = m_queues.size();
+
+		for (int i = 0; i < numQueues; ++i)
+		{
+			WorkQueue& queue = *m_queues.getUnchecked((ownIndex + i) % numQueues);
+			Job* pJob = nullptr;
+
+			{
+				const SpinLock::ScopedLockType sl(queue.lock);
+
+				if (queue.jobs.size() > 0)
+				{
+					// Newest first from our own queue, oldest first when stealing.
+					pJob = queue.jobs.removeAndReturn(i == 0 ? queue.jobs.size() - 1 : 0);
+				}
+			}
+
+			if (pJob != nullptr)
+			{
+				// Signals collapse into one while nobody waits, so whoever takes a job wakes
+				// the next idle worker if any job is left, in this queue or another.
+				if (--m_numQueued > 0)
+					m_workAvailable.signal();
+
+				return pJob;
+			}
+		}
+
+		return nullptr;
+	}
+
+	void execute(Job* pJob)
+	{
+		pJob->run();
+
+		for (int i = 0; i < pJob->m_successors.size(); ++i)
+		{
+			Job* pSuccessor = pJob->m_successors.getUnchecked(i);
+
+			if (--pSuccessor->m_numPending == 0)
+				submit(pSuccessor);
+		}
+
+		pJob->m_pGraph->jobFinished();
+	}
+
+	OwnedArray<WorkQueue>      m_queues;
+	ThreadLocalValue<int>      m_queueIndex;
+	Atomic<int>                m_numQueued;
+	WaitableEvent              m_workAvailable;
+	OwnedArray<Worker>         m_workers;
+};
+
+//==============================================================================
+inline void JobGraph::start(JobSystem& jobSystem)
+{
+	m_pJobSystem = &jobSystem;
+	m_numUnfinished = m_jobs.size();
+	m_finished.reset();
+
+	for (int i = 0; i < m_jobs.size(); ++i)
+		m_jobs.getUnchecked(i)->m_numPending = m_jobs.getUnchecked(i)->m_numDependencies;
+
+	for (int i = 0; i < m_jobs.size(); ++i)
+	{
+		if (m_jobs.getUnchecked(i)->m_numDependencies == 0)
+			jobSystem.submit(m_jobs.getUnchecked(i));
+	}
+}
+
+inline void JobGraph::wait()
+{
+	if (m_pJobSystem == nullptr)
+		return;
+
+	while (m_numUnfinished.get() > 0)
+	{
+		if (!m_pJobSystem->runOneJob())
+			m_finished.wait(-1);
+	}
+
+	// The last job signals just after the count drops; don't return while it still can.
+	m_finished.wait(-1);
+}
+
+#endif // VIRTUALHANDS_JOBSYSTEM_H
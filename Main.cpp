@@ -10,57 +10,16 @@
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "Leap.h"
 #include "LeapUtilGL.h"
+#include "HandScene.h"
+#include "SessionFile.h"
+#include "HeadlessRenderer.h"
+#include "ReplayHarness.h"
+#include "TraceEvents.h"
 #include <cctype>
 
 class FingerVisualizerWindow;
 class OpenGLCanvas;
 
-bool m_useStabelizedPos = false;
-float gTipRadius  = 4.0f;
-
-Leap::Vector sphereInitialPos(0.1f, -1.6f, -0.6f);
-Leap::Vector spherePos = sphereInitialPos;
-Leap::Vector desiredPos = spherePos;
-
-float m_fFrameScale = 0.0075f;;
-float sphereRadius = 50 * m_fFrameScale;
-float shadowsYPos = sphereInitialPos.y - sphereRadius;
-float handY = 0;
-
-Leap::Matrix createTransform(Leap::Vector& forwardVec, Leap::Vector& translation)
-{
-	//OpenGl Look at
-	Leap::Vector z(-forwardVec);
-	Leap::Vector y(0,1,0);
-	Leap::Vector x(0,0,0);
-
-	x = y.cross(z);
-	y = z.cross(x);
-
-	return Leap::Matrix(x, y, z, translation);
-}
-
-// To float vector argument passed to GL functions
-struct GLColor 
-{
-	GLColor() : r(1), g(1), b(1), a(1) {}
-
-	GLColor(float _r, float _g, float _b, float _a=1)
-		: r(_r), g(_g), b(_b), a(_a)
-	{}
-
-	explicit GLColor(const Colour& juceColor) 
-		: r(juceColor.getFloatRed()), 
-		g(juceColor.getFloatGreen()),
-		b(juceColor.getFloatBlue()),
-		a(juceColor.getFloatAlpha())
-	{}
-
-	operator const GLfloat*() const { return &r; }
-
-	GLfloat r, g, b, a; 
-};
-
 //==============================================================================
 class FingerVisualizerApplication  : public JUCEApplication
 {
@@ -78,7 +37,23 @@ public:
 	void initialise (const String& commandLine);
 
 	void shutdown()
-	{ 
+	{
+#if VIRTUALHANDS_HEADLESS
+		if (m_pHeadlessRenderer != nullptr)
+		{
+			setApplicationReturnValue(m_pHeadlessRenderer->succeeded() ? 0 : 1);
+			m_pHeadlessRenderer = nullptr;
+		}
+
+		if (m_pReplayHarness != nullptr)
+		{
+			setApplicationReturnValue(m_pReplayHarness->succeeded() ? 0 : 1);
+			m_pReplayHarness = nullptr;
+		}
+#endif
+
+		// Writes the trace started with --trace, if it is still running.
+		TraceRecorder::stop();
 	}
 
 	//==============================================================================
@@ -117,12 +92,17 @@ public:
 
 private:
 	ScopedPointer<FingerVisualizerWindow>  m_pMainWindow; 
+#if VIRTUALHANDS_HEADLESS
+	ScopedPointer<HeadlessRenderer>        m_pHeadlessRenderer;
+	ScopedPointer<ReplayHarness>           m_pReplayHarness;
+#endif
 };
 
 //==============================================================================
 class OpenGLCanvas  : public Component,
 	public OpenGLRenderer,
-	Leap::Listener
+	Leap::Listener,
+	Timer
 {
 public:
 	OpenGLCanvas()
@@ -145,11 +125,13 @@ public:
 		setWantsKeyboardFocus(true);
 
 		m_bPaused = false;
-		m_bShowDemo = true;
-
-		m_mtxFrameTransform.origin = Leap::Vector(0.0f, -2.0f, 0.5f);
-		m_fPointableRadius = 0.05f;
 		m_bShowHelp = false;
+		m_bScrubbing = false;
+		m_viewLayout = kLayout_Single;
+		m_replayTime = 0;
+		m_fLastReplayTickSeconds = 0;
+		m_fLastSeekMs = 0;
+		m_fTimelinePosition = 0;
 
 		m_strHelp = "ESC - quit\n"
 			"h - Toggle help and frame rate display\n"
@@ -157,7 +139,13 @@ public:
 			"Mouse Drag  - Rotate camera\n"
 			"Mouse Wheel - Zoom camera\n"
 			"Arrow Keys  - Rotate camera\n"
-			"Space       - Reset camera";
+			"Space       - Reset camera\n"
+			"Replays: , . - Step frame, [ ] - Skip 5s\n"
+			"Home/End - Jump to start/end, drag the timeline to scrub\n"
+			"T - Start/stop tracing (written to Documents)\n"
+			"V - Cycle views: single, four views, stereo pair\n"
+			"F - Toggle fingertip trails\n"
+			"K - Add the pose of the first hand to the pose library";
 
 		m_strPrompt = "Press 'd/D' for demo\n"
 			"Press 'h/H' for help";
@@ -171,32 +159,14 @@ public:
 
 	void newOpenGLContextCreated()
 	{
-		glEnable(GL_BLEND);
-		glEnable(GL_TEXTURE_2D);
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
-		glFrontFace(GL_CCW);
-
-		glEnable(GL_DEPTH_TEST);
-		glDepthMask(true);
-		glDepthFunc(GL_LESS);
-
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-		glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
-		glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
-		glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
-		glEnable(GL_COLOR_MATERIAL);
-		glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
-		glShadeModel(GL_SMOOTH);
-
-		glEnable(GL_LIGHTING);
+		m_scene.initGL();
 
 		m_fixedFont = Font("Courier New", 24, Font::plain);
 	}
 
 	void openGLContextClosing()
 	{
+		m_scene.releaseGL();
 	}
 
 	bool keyPressed(const juce::KeyPress& keyPress)
@@ -232,24 +202,42 @@ public:
 			m_camera.RotateOrbit(0, LeapUtil::kfHalfPi * 0.05f, 0);
 			return true;
 		}
+
+		if (m_pReplay != nullptr && keyPressedReplay(iKeyCode))
+			return true;
+
 		switch(iKeyCode)
 		{
 		case ' ':
 			resetCamera();
-			spherePos = sphereInitialPos;
-			desiredPos = spherePos;
+			m_scene.resetDemo();
 			break;
 		case 'H':
 			m_bShowHelp = !m_bShowHelp;
 			break;
 		case 'D':
-			m_bShowDemo = !m_bShowDemo;
+			m_scene.toggleDemo();
 			break;
 		case 'P':
 			m_bPaused = !m_bPaused;
 			break;
 		case 'M':
-			m_useStabelizedPos = !m_useStabelizedPos;
+			m_scene.toggleStabilizedPos();
+			break;
+		case 'F':
+			m_scene.toggleTrails();
+			break;
+		case 'K':
+			capturePose();
+			break;
+		case 'V':
+			m_viewLayout = (m_viewLayout + 1) % kNumLayouts;
+			break;
+		case 'T':
+			if (TraceRecorder::isEnabled())
+				TraceRecorder::stop();
+			else
+				TraceRecorder::start(TraceRecorder::getDefaultFile());
 			break;
 		default:
 			return false;
@@ -260,15 +248,33 @@ public:
 
 	void mouseDown (const MouseEvent& e)
 	{
+		if (m_pReplay != nullptr && getTimelineBounds().contains(e.getPosition()))
+		{
+			m_bScrubbing = true;
+			scrubTo(e.x);
+			return;
+		}
+
 		m_camera.OnMouseDown(LeapUtil::FromVector2(e.getPosition()));
 	}
 
 	void mouseDrag (const MouseEvent& e)
 	{
+		if (m_bScrubbing)
+		{
+			scrubTo(e.x);
+			return;
+		}
+
 		m_camera.OnMouseMoveOrbit(LeapUtil::FromVector2(e.getPosition()));
 		m_openGLContext.triggerRepaint();
 	}
 
+	void mouseUp (const MouseEvent&)
+	{
+		m_bScrubbing = false;
+	}
+
 	void mouseWheelMove (const MouseEvent& e,
 		const MouseWheelDetails& wheel)
 	{
@@ -287,6 +293,8 @@ public:
 
 	void renderOpenGL2D() 
 	{
+		TRACE_SCOPE("renderOpenGL2D");
+
 		LeapUtilGL::GLAttribScope attribScope(GL_ENABLE_BIT);
 
 		glDisable(GL_CULL_FACE);
@@ -328,137 +336,55 @@ public:
 			g.setFont(origFont);
 			g.setFont(static_cast<float>(iFontSize));
 
+			drawPoseMatches(g, iMargin, iBaseLine, iLineStep);
+
 			g.setColour(Colours::hotpink);
 			g.drawMultiLineText(m_strPrompt,
 				iMargin,
 				rectBounds.getBottom() - (iFontSize + iFontSize + iLineStep),
 				rectBounds.getWidth()/4);
-		}
-	}
-
-	//
-	// Calculations that should only be done once per leap data frame but may be drawn many times should go here.
-	//
-	void update(Leap::Frame frame)
-	{
-		ScopedLock sceneLock(m_renderMutex);
-
-		double curSysTimeSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks());
-
-		float deltaTimeSeconds = static_cast<float>(curSysTimeSeconds - m_fLastUpdateTimeSeconds);
-
-		m_fLastUpdateTimeSeconds = curSysTimeSeconds;
-		float fUpdateDT = m_avgUpdateDeltaTime.AddSample(deltaTimeSeconds);
-		float fUpdateFPS = (fUpdateDT > 0) ? 1.0f/fUpdateDT : 0.0f;
-		m_strUpdateFPS = String::formatted("UpdateFPS: %4.2f", fUpdateFPS);
-	}
-
-	// Affects model view matrix. (Needs to be inside a glPush/glPop matrix block)
-	void setupScene()
-	{
-		OpenGLHelpers::clear (Colours::skyblue.withAlpha (1.0f));
-		m_camera.SetAspectRatio(getWidth() / static_cast<float>(getHeight()));
-
-		m_camera.SetupGLProjection();
-
-		m_camera.ResetGLView();
-
-		// left, high, near - corner light
-		LeapUtilGL::GLVector4fv vLight0Position(-3.0f, 3.0f, -3.0f, 1.0f);
-		// right, near - side light
-		LeapUtilGL::GLVector4fv vLight1Position(3.0f, 0.0f, -1.5f, 1.0f);
-		// near - head light
-		LeapUtilGL::GLVector4fv vLight2Position(0.0f, 0.0f,  -3.0f, 1.0f);
 
-		///Turns off the depth test every frame when calling paint.
-		glEnable(GL_DEPTH_TEST);
-		glDepthMask(true);
-		glDepthFunc(GL_LESS);
-
-		glEnable(GL_BLEND);
-		glEnable(GL_TEXTURE_2D);
-
-		glLightModelfv(GL_LIGHT_MODEL_AMBIENT, GLColor(Colours::darkgrey));
-
-		glLightfv(GL_LIGHT0, GL_POSITION, vLight0Position);
-		glLightfv(GL_LIGHT0, GL_DIFFUSE, GLColor(Colour(0.5f, 0.40f, 0.40f, 1.0f)));
-		glLightfv(GL_LIGHT0, GL_AMBIENT, GLColor(Colours::black));
-
-		glLightfv(GL_LIGHT1, GL_POSITION, vLight1Position);
-		glLightfv(GL_LIGHT1, GL_DIFFUSE, GLColor(Colour(0.0f, 0.0f, 0.25f, 1.0f)));
-		glLightfv(GL_LIGHT1, GL_AMBIENT, GLColor(Colours::black));
+			if (m_pReplay != nullptr)
+			{
+				const juce::Rectangle<int> rectTimeline = getTimelineBounds();
 
-		glLightfv(GL_LIGHT2, GL_POSITION, vLight2Position);
-		glLightfv(GL_LIGHT2, GL_DIFFUSE, GLColor(Colour(0.15f, 0.15f, 0.15f, 1.0f)));
-		glLightfv(GL_LIGHT2, GL_AMBIENT, GLColor(Colours::black));
+				g.setColour(Colours::black.withAlpha(0.4f));
+				g.fillRect(rectTimeline);
 
-		glEnable(GL_LIGHT0);
-		//glEnable(GL_LIGHT1);
-		//glEnable(GL_LIGHT2);
+				g.setColour(Colours::hotpink);
+				g.fillRect(rectTimeline.getX(), rectTimeline.getY(),
+					roundToInt(rectTimeline.getWidth() * m_fTimelinePosition), rectTimeline.getHeight());
 
-		m_camera.SetupGLView();
+				g.setColour(Colours::seagreen);
+				g.drawText(m_strTimeline, rectTimeline.getX(), rectTimeline.getY() - iLineStep,
+					rectTimeline.getWidth(), iFontSize, Justification::centredRight, false);
+			}
+		}
 	}
 
-	void updateDemo(Leap::Frame frame, bool isShadow = false)
+	//
+	// Calculations that should only be done once per leap data frame but may be drawn many times should go here.
+	//
+	void update(const FrameSnapshot& frame)
 	{
-		//glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		TRACE_SCOPE("update");
 
-		if (isShadow)
 		{
-			glEnable (GL_BLEND);
-			glColor4f(0,0,0,0.2f);
-			glPushMatrix();
-			glTranslatef(spherePos.x, shadowsYPos, spherePos.z);
-			glScalef(sphereRadius * 1.2f, sphereRadius * 0.001f, sphereRadius * 1.2f);
-			LeapUtilGL::drawSphere(LeapUtilGL::kStyle_Solid);
-			glPopMatrix();
-			glDisable (GL_BLEND);
-		}
+			ScopedLock sceneLock(m_renderMutex);
 
-		glColor3f(0.3f, 0.6f,0.1f);
+			double curSysTimeSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks());
 
-		glPushMatrix();
-		glTranslatef(spherePos.x, spherePos.y, spherePos.z);
-		glScalef(sphereRadius, sphereRadius, sphereRadius);
-		LeapUtilGL::drawSphere(LeapUtilGL::kStyle_Solid);
-		glPopMatrix();
+			float deltaTimeSeconds = static_cast<float>(curSysTimeSeconds - m_fLastUpdateTimeSeconds);
 
-		using namespace Leap;
-		if (!frame.hands().isEmpty()) 
-		{
-			for (int handCount = 0; handCount < frame.hands().count(); ++handCount)
-			{
-				const Hand hand = frame.hands()[handCount];
-				// Check if the hand has any fingers
-				const FingerList& fingers = hand.fingers();
-				if (!fingers.isEmpty()) 
-				{
-					for (int fingerCount = 0; fingerCount < fingers.count(); ++fingerCount)
-					{
-						Finger finger = fingers[fingerCount];
-
-						Leap::Vector stabelizedPos = m_mtxFrameTransform.transformPoint(finger.stabilizedTipPosition() * m_fFrameScale);
-						Leap::Vector tipPos = m_mtxFrameTransform.transformPoint(finger.tipPosition() * m_fFrameScale);
-						Leap::Vector tipVelocity = finger.tipVelocity();
-
-						float radius = (gTipRadius* m_fFrameScale) + sphereRadius;
-						Leap::Vector distance = tipPos - spherePos;
-						float length = distance.magnitude();
-
-						//Collision
-						if (length <= radius)
-						{
-							tipVelocity.y = 0;
-							spherePos.y = sphereInitialPos.y;
-							desiredPos.x = spherePos.x + (tipVelocity.x * m_fFrameScale);
-							desiredPos.z = spherePos.z + (tipVelocity.z * m_fFrameScale);
-						}
-					}
-				}
-				spherePos = spherePos + (desiredPos - spherePos) * 0.1f;
-			}
+			m_fLastUpdateTimeSeconds = curSysTimeSeconds;
+			float fUpdateDT = m_avgUpdateDeltaTime.AddSample(deltaTimeSeconds);
+			float fUpdateFPS = (fUpdateDT > 0) ? 1.0f/fUpdateDT : 0.0f;
+			m_strUpdateFPS = String::formatted("UpdateFPS: %4.2f", fUpdateFPS);
 		}
 
+		// Runs on the job system, not under the render lock: the GL thread keeps
+		// drawing the previous frame while this one is processed.
+		m_scene.update(frame);
 	}
 
 	// Data should be drawn here but no heavy calculations done.
@@ -472,7 +398,7 @@ public:
 				return;
 		}
 
-		Leap::Frame frame = m_lastFrame;
+		TRACE_SCOPE("renderOpenGL");
 
 		double  curSysTimeSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks());
 		float   fRenderDT = static_cast<float>(curSysTimeSeconds - m_fLastRenderTimeSeconds);
@@ -484,20 +410,7 @@ public:
 		m_strRenderFPS = String::formatted("RenderFPS: %4.2f", fRenderFPS);
 
 		//now draw the scene over the shadows
-		{
-			setupScene();
-			drawBackground();
-
-			// draw fingers with sphere at the tip.
-			drawHands(frame, true);
-			drawHands(frame);
-
-			if (m_bShowDemo)
-			{
-				updateDemo(frame,true);
-				updateDemo(frame,false);
-			}
-		}
+		renderViews();
 
 		{
 			ScopedLock renderLock(m_renderMutex);
@@ -507,299 +420,328 @@ public:
 		}
 	}
 
-	void drawBackground()
+	virtual void onInit(const Leap::Controller&) 
+	{
+	}
+
+	virtual void onConnect(const Leap::Controller&) 
+	{
+	}
+
+	virtual void onDisconnect(const Leap::Controller&) 
+	{
+	}
+
+	virtual void onFrame(const Leap::Controller& controller)
 	{
-		glColor3f(0.15f, 0.15f, 0.1f);
+		if (!m_bPaused && m_pReplay == nullptr)
 		{
-			glPushMatrix();
-			glTranslatef(0, shadowsYPos + -0.05f, 0);
-			glScalef(40,0.01f,40);
-			LeapUtilGL::drawBox(LeapUtilGL::kStyle_Solid);	
-			glPopMatrix();
+			FrameSnapshot frame;
+			extractSnapshot(controller.frame(), frame);
+
+			if (m_pRecorder != nullptr)
+				m_pRecorder->writeFrame(frame);
+
+			update(frame);
+			m_openGLContext.triggerRepaint();
 		}
 	}
 
-	void drawHands(Leap::Frame frame, bool isShadow = false)
+
+	// Records every frame from the controller until the canvas is destroyed.
+	bool startRecording(const File& file)
 	{
-		glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		m_pRecorder = new SessionWriter(file);
 
-		if (isShadow)
-		{
-			glEnable (GL_BLEND);
-			glColor4f(0,0,0,0.2f);
-			glPushMatrix();
-			glTranslatef(0, shadowsYPos, 0);
-			float maxScale = 4.0f;
-			float minScale = 2.0f;
+		if (!m_pRecorder->isOpen())
+			m_pRecorder = nullptr;
 
-			float maxH = 4;
+		return m_pRecorder != nullptr;
+	}
 
-			float currH = handY / maxH;
-			if (currH > maxH)
-				currH = maxH;
+	// Live hands are matched against the poses in the file, and K adds poses to it.
+	// The file is created by the first K if it does not exist yet.
+	void setPoseLibraryFile(const File& file)
+	{
+		m_poseLibraryFile = file;
 
-			float scale = ((maxScale - minScale) * currH) + minScale;
+		if (!file.existsAsFile())
+			return;
 
-			glScalef(scale, 0.001f, scale);
-		}
+		ScopedPointer<PoseLibrary> library(new PoseLibrary(file));
 
-		using namespace Leap;
-		LeapUtilGL::GLAttribScope colorScope(GL_CURRENT_BIT | GL_LINE_BIT);
-		if (!frame.hands().isEmpty()) 
-		{
-			//Get the first hand
-			for (int handCount = 0; handCount < frame.hands().count(); ++handCount)
-			{
-				const Hand hand = frame.hands()[handCount];
+		if (library->isValid())
+			m_scene.setPoseLibrary(library.release());
+		else
+			Logger::writeToLog("Could not read pose library " + file.getFullPathName());
+	}
 
-				//Find the thumb
-				int thumbId = 0;
+	// Static props to draw around the hands, from a JSON scene or a compiled index.
+	bool setStaticSceneFile(const File& file)
+	{
+		const File index(StaticSceneBuilder::compile(file));
 
-				/*
-				Note that the the leftmost() and rightmost() functions only identify which hand is farthest to the left or to the right. 
-				The functions do not identify which hand is the right or the left hand.
-				*/
-				//Leap does not know which hand is which... lets assume their relative position
-				if (frame.hands().count() == 2)
-				{
-					if (hand.id() == frame.hands().leftmost().id())
-						thumbId = hand.fingers().rightmost().id();
-					else 
-						thumbId = hand.fingers().leftmost().id();
-				};
-
-				const Vector normal = hand.palmNormal();
-				const Vector direction = hand.direction();
-				const float RAD_2_DEG = 57.2957795f;
-				//float angle = hand.rotationAngle(frame);
-				Leap::Vector handPos = m_mtxFrameTransform.transformPoint(hand.palmPosition()* m_fFrameScale);
-				Leap::Vector handDir = hand.direction();
-				Leap::Vector wristPos = handPos + (-handDir * (hand.sphereRadius() / 2.0f) * m_fFrameScale);	
-
-				handY = handPos.y;
-
-				// Check if the hand has any fingers
-				const FingerList& fingers = hand.fingers();
-				if (!fingers.isEmpty()) 
-				{
-					for (int fingerCount = 0; fingerCount < fingers.count(); ++fingerCount)
-					{
-						Finger finger = fingers[fingerCount];
-						float fingerLength = finger.length();
-
-						Leap::Vector stabelizedPos = finger.stabilizedTipPosition();
-						Leap::Vector tipPos;
-						if (m_useStabelizedPos)
-						{
-							tipPos = stabelizedPos;
-						}
-						else
-						{
-							tipPos = finger.tipPosition();
-						}
-
-						Leap::Vector vStartPos = m_mtxFrameTransform.transformPoint(tipPos * m_fFrameScale);
-						Leap::Vector vFingerDir = -m_mtxFrameTransform.transformDirection(finger.direction()); //negative because we want to know the opposite direction to draw the bones
-						Leap::Vector vEndRelativePos   = vFingerDir * fingerLength * m_fFrameScale;
-						Leap::Vector vLastJointPos;
-						{		
-							//Finger nail
-							if (!isShadow)
-							{
-								glColor3f(0.0f, 0.2f, 1.0f);
-
-								glPushMatrix();
-								//base translation
-								glTranslatef(vStartPos.x, vStartPos.y, vStartPos.z);
-								glScalef(m_fFrameScale * gTipRadius , m_fFrameScale * gTipRadius, m_fFrameScale * gTipRadius);
-								//LeapUtilGL::drawSphere(LeapUtilGL::kStyle_Solid);
-								glPopMatrix();
-							}
-
-							//Joints
-							int numJoints = thumbId == finger.id() ? 2 : 3; //thumb has only 2 joints.
-							float splitSize = fingerLength / (float)numJoints;
-
-							//Counts nail as joint and skip it
-							//Leap motion does not detect joints, sight, but we are going to fake it by assuming the last joint never moves
-							Leap::Vector prevPos = vStartPos;
-							for (int i = 0; i < numJoints; ++ i)
-							{		
-								Leap::Vector desiredDir;
-								if (i+1 == numJoints) //last joint
-								{
-									desiredDir = (wristPos - prevPos).normalized();
-								}
-								else
-								{
-									desiredDir = vFingerDir;
-								}
-
-								Leap::Vector jointEndPos = (desiredDir * splitSize * m_fFrameScale);
-								Leap::Vector jointPos = prevPos + jointEndPos;								
-
-								if (!isShadow)
-								{
-									glColor3f(0.0f, 0.0f, 0.0f);
-
-									//Finger bone
-									glBegin(GL_LINES);
-									glVertex3fv(prevPos.toFloatPointer());
-									glVertex3fv(jointPos.toFloatPointer());
-									glEnd();
-								}
-
-								prevPos = jointPos;
-								vLastJointPos = jointPos;
-
-								if (!isShadow)
-								{
-									glColor3f(0.0f, 0.2f, 1.0f);
-
-									//joint
-									glPushMatrix();
-									glTranslatef(jointPos.x, jointPos.y, jointPos.z);
-									glScalef(3.0f * m_fFrameScale, 3.0f * m_fFrameScale,  3.0f * m_fFrameScale);
-									LeapUtilGL::drawSphere(LeapUtilGL::kStyle_Solid);
-									glPopMatrix();	
-								}
-
-								//Joint outline
-								if (!isShadow)
-								{
-									glEnable (GL_BLEND);
-									glColor4f(1,0,1,0.5f);
-								}
-
-								glPushMatrix();
-								Leap::Vector vHalfEndPos = vEndRelativePos * 0.5f;
-								Leap::Vector jointOutlinePos = jointPos - (jointEndPos/2); 
-
-								Leap::Matrix model = createTransform(desiredDir, jointOutlinePos);
-
-								//Rotate
-								//Finger outline.
-								glMultMatrixf(model.toArray4x4());
-								//Rotation.
-								//Use the hand normal to create a new lookat for the finger and use the direction as z
-								glScalef(0.075f, 0.075f, splitSize * m_fFrameScale);
-								LeapUtilGL::drawBox(LeapUtilGL::kStyle_Solid);
-								glPopMatrix();	
-
-								if (!isShadow)
-									glDisable (GL_BLEND);
-							}	
-
-							if (!isShadow)
-							{
-								//note the previous vEndPos was relative to vStartPos not absolute
-								//knuckle bone to wrist
-								glBegin(GL_LINES);
-								glVertex3fv(wristPos.toFloatPointer());
-								glVertex3fv(vLastJointPos.toFloatPointer());
-								glEnd();
-							}
-						}
-					}
-				}
+		if (!index.existsAsFile())
+			return false;
 
-				//HAND
-				{
-					// Approximation, the hand size is the size of the sphere we can handle minus the size of the biggest finger
-					float handSize = 50;//hand.sphereRadius() - hand.fingers().frontmost().length();
-					//hand centre
-					glPushMatrix();
+		ScopedPointer<StaticScene> scene(new StaticScene(index));
 
-					glTranslatef(handPos.x, handPos.y, handPos.z);
+		if (!scene->isValid())
+			return false;
 
-					glRotatef(direction.yaw() * -RAD_2_DEG, 0, 1, 0);
-					glRotatef(direction.pitch() * RAD_2_DEG, 1, 0, 0);
-					glRotatef(normal.roll() * RAD_2_DEG, 0, 0, 1);
+		m_scene.setStaticScene(scene.release());
+		return true;
+	}
 
-					glPushMatrix();
-					glScalef(m_fFrameScale * 4 , m_fFrameScale * 4, m_fFrameScale * 4);
-					LeapUtilGL::drawSphere(LeapUtilGL::kStyle_Solid);
-					glPopMatrix();
+	// Shows a recorded session instead of the controller, starting at the given session time.
+	bool startReplay(const File& file, int64 startTime)
+	{
+		m_pReplay = new SessionReader(file);
 
-					if (!isShadow)
-					{
-						//hand outline
-						glEnable (GL_BLEND);
-						glColor4f(1,0,1,0.5f);
-					}
+		if (!m_pReplay->isValid())
+		{
+			m_pReplay = nullptr;
+			return false;
+		}
 
-					glPushMatrix();
-					glScalef(handSize * 0.75f * m_fFrameScale, 0.15f, handSize * 0.75f * m_fFrameScale);
-					LeapUtilGL::drawSphere(LeapUtilGL::kStyle_Solid);
-					glPopMatrix();
+		seekReplayToTime(startTime);
+		m_fLastReplayTickSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks());
+		startTimer(10);
+		return true;
+	}
 
-					if (!isShadow)
-						glDisable (GL_BLEND);
+	// Replays advance on the message thread, which is also where every seek comes from.
+	void timerCallback()
+	{
+		double curSysTimeSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks());
 
-					glPopMatrix();
-				}				
+		if (!m_bPaused && !m_bScrubbing)
+		{
+			m_replayTime += static_cast<int64>((curSysTimeSeconds - m_fLastReplayTickSeconds) * 1000000.0);
 
-				if (!isShadow)
-				{
-					//wrist
-					{
-						glColor3f(0.1f, 0.1f, 1.0f);
-
-						//hand.sphereCenter()
-						glPushMatrix();
-						glTranslatef(wristPos.x, wristPos.y, wristPos.z);
-
-						glScalef(m_fFrameScale * 4 , m_fFrameScale * 4, m_fFrameScale * 4);
-						LeapUtilGL::drawSphere(LeapUtilGL::kStyle_Solid);
-						glPopMatrix();
-					}		
-
-					//wrist to the center of the hand
-					{
-						glBegin(GL_LINES);
-						glVertex3fv(wristPos.toFloatPointer());
-						glVertex3fv(handPos.toFloatPointer());
-						glEnd();
-					}
-				}
+			FrameSnapshot frame;
+			if (m_pReplay->advanceTo(m_replayTime, frame))
+			{
+				update(frame);
+				updateTimeline();
+				m_openGLContext.triggerRepaint();
 			}
+
+			if (m_pReplay->isFinished())
+				m_bPaused = true;
 		}
 
-		if (isShadow)
+		m_fLastReplayTickSeconds = curSysTimeSeconds;
+	}
+
+	bool keyPressedReplay(int iKeyCode)
+	{
+		const int64 skipTime = 5000000;
+
+		if (iKeyCode == juce::KeyPress::homeKey)
 		{
-			glPopMatrix();
-			glDisable (GL_BLEND);
+			seekReplayToTime(0);
+			return true;
 		}
+
+		if (iKeyCode == juce::KeyPress::endKey)
+		{
+			seekReplayToFrame(m_pReplay->getNumFrames() - 1);
+			return true;
+		}
+
+		switch(iKeyCode)
+		{
+		case ',':
+			m_bPaused = true;
+			seekReplayToFrame(m_pReplay->getFrameNumber() - 1);
+			break;
+		case '.':
+			m_bPaused = true;
+			seekReplayToFrame(m_pReplay->getFrameNumber() + 1);
+			break;
+		case '[':
+			seekReplayToTime(m_pReplay->getTime() - skipTime);
+			break;
+		case ']':
+			seekReplayToTime(m_pReplay->getTime() + skipTime);
+			break;
+		case 'P':
+			// Resuming at the end starts over.
+			if (m_bPaused && m_pReplay->isFinished())
+				seekReplayToTime(0);
+			return false;
+		default:
+			return false;
+		}
+
+		return true;
 	}
 
-	virtual void onInit(const Leap::Controller&) 
+	juce::Rectangle<int> getTimelineBounds() const
 	{
+		return juce::Rectangle<int>(getWidth() / 4, getHeight() - 24, getWidth() * 3 / 4 - 10, 14);
 	}
 
-	virtual void onConnect(const Leap::Controller&) 
+	void scrubTo(int x)
 	{
+		const juce::Rectangle<int> rectTimeline = getTimelineBounds();
+		const double fPosition = jlimit(0.0, 1.0, (x - rectTimeline.getX()) / static_cast<double>(rectTimeline.getWidth()));
+
+		seekReplayToTime(static_cast<int64>(fPosition * m_pReplay->getDuration()));
 	}
 
-	virtual void onDisconnect(const Leap::Controller&) 
+	void seekReplayToTime(int64 sessionTime)
 	{
+		const int64 startTicks = Time::getHighResolutionTicks();
+		FrameSnapshot frame;
+
+		if (m_pReplay->seekToTime(sessionTime, frame))
+			seekReplayDone(frame, startTicks);
 	}
 
-	virtual void onFrame(const Leap::Controller& controller)
+	void seekReplayToFrame(int64 frameNumber)
+	{
+		const int64 startTicks = Time::getHighResolutionTicks();
+		FrameSnapshot frame;
+
+		if (m_pReplay->seekToFrame(frameNumber, frame))
+			seekReplayDone(frame, startTicks);
+	}
+
+	void seekReplayDone(const FrameSnapshot& frame, int64 startTicks)
+	{
+		m_fLastSeekMs = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks) * 1000.0;
+		m_replayTime = m_pReplay->getTime();
+
+		update(frame);
+		updateTimeline();
+		m_openGLContext.triggerRepaint();
+	}
+
+	void updateTimeline()
+	{
+		ScopedLock sceneLock(m_renderMutex);
+
+		const int64 duration = m_pReplay->getDuration();
+
+		m_fTimelinePosition = duration > 0 ? static_cast<float>(m_pReplay->getTime() / static_cast<double>(duration)) : 0.0f;
+		m_strTimeline = String::formatted("%.3fs / %.3fs  frame %d / %d  seek %.2fms",
+			m_pReplay->getTime() / 1000000.0, duration / 1000000.0,
+			static_cast<int>(m_pReplay->getFrameNumber() + 1), static_cast<int>(m_pReplay->getNumFrames()),
+			m_fLastSeekMs);
+	}
+
+	void capturePose()
+	{
+		float features[PoseFeatures::kNumFeatures];
+
+		if (m_poseLibraryFile == File::nonexistent || !m_scene.getLatestPoseFeatures(0, features))
+			return;
+
+		PoseLibraryWriter writer;
+
+		if (const PoseLibrary* library = m_scene.getPoseLibrary())
+			writer.addPoses(*library);
+
+		writer.addPose("pose " + String(writer.getNumPoses() + 1), features);
+
+		// The file is mapped while the library is in use.
+		m_scene.setPoseLibrary(nullptr);
+
+		if (!writer.writeTo(m_poseLibraryFile))
+			Logger::writeToLog("Could not write pose library " + m_poseLibraryFile.getFullPathName());
+
+		setPoseLibraryFile(m_poseLibraryFile);
+	}
+
+	// The nearest library poses of every hand, top right.
+	void drawPoseMatches(Graphics& g, int iMargin, int iBaseLine, int iLineStep)
 	{
-		if (!m_bPaused)
+		if (m_scene.getPoseLibrary() == nullptr)
+			return;
+
+		g.setColour(Colours::darkorange);
+
+		for (int handCount = 0; handCount < m_scene.getNumDisplayedHands(); ++handCount)
 		{
-			Leap::Frame frame = controller.frame();
-			update(frame);
-			m_lastFrame = frame;
-			m_openGLContext.triggerRepaint();
+			const PoseMatches& matches = m_scene.getDisplayedPoseMatches(handCount);
+			String strMatches = String::formatted("Hand %d:", handCount + 1);
+
+			for (int i = 0; i < matches.numMatches; ++i)
+				strMatches << String::formatted(" %s (%.2f)", matches.matches[i].name, matches.matches[i].distance);
+
+			g.drawText(strMatches, iMargin, iBaseLine + iLineStep * (handCount - 1), getWidth() - iMargin * 2, iLineStep,
+				Justification::centredRight, false);
 		}
 	}
 
-
 	void resetCamera()
 	{
 		m_camera.SetOrbitTarget(Leap::Vector::zero());
 		m_camera.SetPOVLookAt(Leap::Vector(0, 6, 10), m_camera.GetOrbitTarget());
+
+		// The fixed views of the four view layout: top, side and front.
+		m_fixedCameras[0].SetPOVLookAt(Leap::Vector(0, 12, 0), Leap::Vector::zero(), Leap::Vector(0, 0, -1));
+		m_fixedCameras[1].SetPOVLookAt(Leap::Vector(12, 0, 0), Leap::Vector::zero());
+		m_fixedCameras[2].SetPOVLookAt(Leap::Vector(0, 0, 12), Leap::Vector::zero());
+	}
+
+	// Every view draws the same processed frame, only culling and the camera
+	// matrices are done per view. The mouse and arrow keys move m_camera.
+	void renderViews()
+	{
+		const int width = getWidth();
+		const int height = getHeight();
+		const int halfWidth = width / 2;
+		const int halfHeight = height / 2;
+
+		m_scene.beginFrame();
+
+		glEnable(GL_SCISSOR_TEST);
+
+		switch (m_viewLayout)
+		{
+		case kLayout_Quad:
+			// GL viewports start at the bottom left.
+			renderView(m_camera, 0, height - halfHeight, halfWidth, halfHeight);
+			renderView(m_fixedCameras[0], halfWidth, height - halfHeight, width - halfWidth, halfHeight);
+			renderView(m_fixedCameras[1], 0, 0, halfWidth, height - halfHeight);
+			renderView(m_fixedCameras[2], halfWidth, 0, width - halfWidth, height - halfHeight);
+			break;
+		case kLayout_Stereo:
+			{
+				// Parallel eyes either side of m_camera.
+				const float fEyeSeparation = 0.3f;
+				Leap::Matrix pov = m_camera.GetPOV();
+				const Leap::Vector vCentre = pov.origin;
+				const Leap::Vector vOffset = pov.xBasis.normalized() * (fEyeSeparation / 2);
+
+				pov.origin = vCentre - vOffset;
+				m_eyeCameras[0].SetPOV(pov);
+				pov.origin = vCentre + vOffset;
+				m_eyeCameras[1].SetPOV(pov);
+
+				renderView(m_eyeCameras[0], 0, 0, halfWidth, height);
+				renderView(m_eyeCameras[1], halfWidth, 0, width - halfWidth, height);
+			}
+			break;
+		default:
+			renderView(m_camera, 0, 0, width, height);
+			break;
+		}
+
+		glDisable(GL_SCISSOR_TEST);
+		glViewport(0, 0, width, height);
+	}
+
+	void renderView(LeapUtilGL::CameraGL& camera, int x, int y, int width, int height)
+	{
+		glViewport(x, y, width, height);
+		glScissor(x, y, width, height);
+
+		m_scene.setupScene(camera, width, jmax(1, height));
+		m_scene.renderView(camera);
 	}
 
 	void initColors()
@@ -844,11 +786,21 @@ public:
 private:
 	OpenGLContext               m_openGLContext;
 	LeapUtilGL::CameraGL        m_camera;
-	Leap::Frame                 m_lastFrame;
+	LeapUtilGL::CameraGL        m_fixedCameras[3];
+	LeapUtilGL::CameraGL        m_eyeCameras[2];
+	int                         m_viewLayout;
+	HandScene                   m_scene;
+	ScopedPointer<SessionWriter> m_pRecorder;
+	ScopedPointer<SessionReader> m_pReplay;
+	File                        m_poseLibraryFile;
+	int64                       m_replayTime;
+	double                      m_fLastReplayTickSeconds;
+	double                      m_fLastSeekMs;
+	float                       m_fTimelinePosition;
+	String                      m_strTimeline;
+	bool                        m_bScrubbing;
 	double                      m_fLastUpdateTimeSeconds;
 	double                      m_fLastRenderTimeSeconds;
-	Leap::Matrix                m_mtxFrameTransform;
-	float                       m_fPointableRadius;
 	LeapUtil::RollingAverage<>  m_avgUpdateDeltaTime;
 	LeapUtil::RollingAverage<>  m_avgRenderDeltaTime;
 	String                      m_strUpdateFPS;
@@ -859,9 +811,9 @@ private:
 	CriticalSection             m_renderMutex;
 	bool                        m_bShowHelp;
 	bool                        m_bPaused;
-	bool                        m_bShowDemo;
 
 	enum  { kNumColors = 256 };
+	enum  { kLayout_Single, kLayout_Quad, kLayout_Stereo, kNumLayouts };
 	Leap::Vector            m_avColors[kNumColors];
 };
 
@@ -874,13 +826,28 @@ class FingerVisualizerWindow  : public DocumentWindow
 {
 public:
 	//==============================================================================
-	FingerVisualizerWindow()
+	FingerVisualizerWindow(const File& recordingFile, const File& replayFile, int64 replayStartTime,
+		const File& poseLibraryFile, const File& staticSceneFile)
 		: DocumentWindow ("Virtual Hands",
 		Colours::lightgrey,
 		DocumentWindow::allButtons,
 		true)
 	{
-		setContentOwned (new OpenGLCanvas(), true);
+		OpenGLCanvas* pCanvas = new OpenGLCanvas();
+
+		if (recordingFile != File::nonexistent && !pCanvas->startRecording(recordingFile))
+			Logger::writeToLog("Could not record to " + recordingFile.getFullPathName());
+
+		if (replayFile != File::nonexistent && !pCanvas->startReplay(replayFile, replayStartTime))
+			Logger::writeToLog("Could not replay " + replayFile.getFullPathName());
+
+		if (poseLibraryFile != File::nonexistent)
+			pCanvas->setPoseLibraryFile(poseLibraryFile);
+
+		if (staticSceneFile != File::nonexistent && !pCanvas->setStaticSceneFile(staticSceneFile))
+			Logger::writeToLog("Could not load scene " + staticSceneFile.getFullPathName());
+
+		setContentOwned (pCanvas, true);
 
 		// Centre the window on the screen
 		centreWithSize (getWidth(), getHeight());
@@ -904,11 +871,95 @@ public:
 	}
 };
 
+// Returns the argument following the given option, or an empty string.
+static String getOptionValue(const StringArray& args, const String& option)
+{
+	int index = args.indexOf(option);
+
+	return (index >= 0 && index + 1 < args.size()) ? args[index + 1].unquoted() : String::empty;
+}
+
+static File getOptionFile(const StringArray& args, const String& option)
+{
+	String path = getOptionValue(args, option);
+
+	return path.isEmpty() ? File::nonexistent : File::getCurrentWorkingDirectory().getChildFile(path);
+}
+
 void FingerVisualizerApplication::initialise (const String& commandLine)
 {
-	(void) commandLine;
+	StringArray args;
+	args.addTokens(commandLine, true);
+
+	if (args.contains("--trace"))
+	{
+		const String traceFile(getOptionValue(args, "--trace"));
+
+		TraceRecorder::start(traceFile.isEmpty() || traceFile.startsWith("--") ? TraceRecorder::getDefaultFile()
+			: getOptionFile(args, "--trace"));
+	}
+
+	if (args.contains("--harness"))
+	{
+#if VIRTUALHANDS_HEADLESS
+		HarnessSettings settings;
+		settings.budgetsFile = getOptionFile(args, "--harness");
+		settings.reportFile  = getOptionFile(args, "--report");
+		settings.hashesFile  = getOptionFile(args, "--hashes");
+
+		m_pReplayHarness = new ReplayHarness(settings);
+		m_pReplayHarness->startThread();
+#else
+		Logger::writeToLog("This build has no headless rendering support");
+		setApplicationReturnValue(1);
+		quit();
+#endif
+		return;
+	}
+
+	if (args.contains("--headless"))
+	{
+#if VIRTUALHANDS_HEADLESS
+		HeadlessSettings settings;
+		settings.replayFile = getOptionFile(args, "--replay");
+		settings.output     = getOptionFile(args, "--output");
+
+		if (getOptionValue(args, "--format").equalsIgnoreCase("y4m"))
+			settings.format = FrameEncoder::kFormat_Y4M;
+
+		String size = getOptionValue(args, "--size");
+		if (size.containsChar('x'))
+		{
+			// Y4M chroma planes are subsampled, so keep both dimensions even.
+			settings.width  = jmax(2, size.upToFirstOccurrenceOf("x", false, true).getIntValue()) & ~1;
+			settings.height = jmax(2, size.fromFirstOccurrenceOf("x", false, true).getIntValue()) & ~1;
+		}
+
+		if (getOptionValue(args, "--fps").getIntValue() > 0)
+			settings.fps = getOptionValue(args, "--fps").getIntValue();
+
+		if (getOptionValue(args, "--encoders").getIntValue() > 0)
+			settings.numEncoderThreads = getOptionValue(args, "--encoders").getIntValue();
+
+		settings.maxFrames = jmax((int64) 0, getOptionValue(args, "--frames").getLargeIntValue());
+		settings.bDropFrames = args.contains("--drop-frames");
+
+		m_pHeadlessRenderer = new HeadlessRenderer(settings);
+		m_pHeadlessRenderer->startThread();
+#else
+		Logger::writeToLog("This build has no headless rendering support");
+		setApplicationReturnValue(1);
+		quit();
+#endif
+		return;
+	}
+
 	// Do your application's initialisation code here.
-	m_pMainWindow = new FingerVisualizerWindow();
+	m_pMainWindow = new FingerVisualizerWindow(getOptionFile(args, "--record"),
+		getOptionFile(args, "--replay"),
+		static_cast<int64>(getOptionValue(args, "--seek").getDoubleValue() * 1000000.0),
+		getOptionFile(args, "--poses"),
+		getOptionFile(args, "--scene"));
 }
 
 //==============================================================================
@@ -0,0 +1,366 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_POSELIBRARY_H
+#define VIRTUALHANDS_POSELIBRARY_H
+
+#include "HandSnapshot.h"
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+ #define VIRTUALHANDS_USE_SSE 1
+ #include <xmmintrin.h>
+#endif
+
+//==============================================================================
+// A hand pose reduced to kNumFeatures floats. The squared distance between two
+// feature vectors says how different the poses are.
+//
+// Fingertips and finger directions are taken in the palm's own frame, so only the
+// shape of the hand counts, not where it is. The palm normal and hand direction are
+// kept in device space, so a flat hand facing down differs from one facing up.
+// The weights are applied here, so matching needs no more than a plain distance.
+namespace PoseFeatures
+{
+	enum { kNumFeatures = 32 };
+
+	const float kPositionScale     = 1.0f / 100.0f;   // Leap millimetres, about a hand length
+	const float kDirectionWeight   = 0.5f;
+	const float kOrientationWeight = 0.5f;
+	const float kFingerCountWeight = 0.2f;
+
+	// Per finger slot: tip x, y, z and direction x, y in palm space. Fingers are sorted
+	// from one side of the palm to the other; slots of fingers Leap cannot see stay zero.
+	// Then palm normal, hand direction and the number of fingers.
+	inline void extract(const HandSnapshot& hand, float* features)
+	{
+		zeromem(features, sizeof(float) * kNumFeatures);
+
+		const Leap::Vector side = hand.direction.cross(hand.palmNormal).normalized();
+		const Leap::Vector normal = side.cross(hand.direction).normalized();
+		const Leap::Vector& forward = hand.direction;
+
+		int order[HandSnapshot::kMaxFingers];
+		float across[HandSnapshot::kMaxFingers];
+
+		for (int fingerCount = 0; fingerCount < hand.numFingers; ++fingerCount)
+		{
+			order[fingerCount] = fingerCount;
+			across[fingerCount] = (hand.fingers[fingerCount].tipPosition - hand.palmPosition).dot(side);
+		}
+
+		// At most five, insertion sort is plenty.
+		for (int i = 1; i < hand.numFingers; ++i)
+			for (int j = i; j > 0 && across[order[j]] < across[order[j - 1]]; --j)
+				std::swap(order[j], order[j - 1]);
+
+		for (int slot = 0; slot < hand.numFingers; ++slot)
+		{
+			const FingerSnapshot& finger = hand.fingers[order[slot]];
+			const Leap::Vector tip = (finger.tipPosition - hand.palmPosition) * kPositionScale;
+			float* f = features + slot * 5;
+
+			f[0] = tip.dot(side);
+			f[1] = tip.dot(normal);
+			f[2] = tip.dot(forward);
+			f[3] = finger.direction.dot(side) * kDirectionWeight;
+			f[4] = finger.direction.dot(normal) * kDirectionWeight;
+		}
+
+		float* f = features + HandSnapshot::kMaxFingers * 5;
+
+		f[0] = hand.palmNormal.x * kOrientationWeight;
+		f[1] = hand.palmNormal.y * kOrientationWeight;
+		f[2] = hand.palmNormal.z * kOrientationWeight;
+		f[3] = hand.direction.x * kOrientationWeight;
+		f[4] = hand.direction.y * kOrientationWeight;
+		f[5] = hand.direction.z * kOrientationWeight;
+		f[6] = hand.numFingers * kFingerCountWeight;
+	}
+}
+
+//==============================================================================
+// A pose library file is a header, then the feature vectors of all poses packed
+// back to back, then a fixed size name per pose:
+//
+//   magic, version, number of poses, features per pose    int32 each
+//   features                                               float[numPoses][kNumFeatures]
+//   names                                                  char[numPoses][kNameSize], zero padded
+//
+// Everything is little endian. Feature vectors start 16 bytes into the file, so the
+// library is matched straight out of the memory mapping without a copy.
+namespace PoseLibraryFormat
+{
+	const int kMagic      = 0x4c504856; // "VHPL"
+	const int kVersion    = 1;
+	const int kHeaderSize = 16;
+	const int kNameSize   = 32;
+}
+
+struct PoseMatch
+{
+	int   index;
+	float distance;
+	char  name[PoseLibraryFormat::kNameSize];
+};
+
+// The nearest poses to one hand, nearest first.
+struct PoseMatches
+{
+	enum { kMaxMatches = 3 };
+
+	PoseMatches() : numMatches(0) {}
+
+	int       numMatches;
+	PoseMatch matches[kMaxMatches];
+};
+
+//==============================================================================
+// Reference poses to match live hands against, read through a memory mapping.
+//
+// Matching is a brute force scan. A pose is 128 bytes, so ten thousand poses are
+// 1.25MB that stream through the cache in well under 100us; at that size a tree
+// would cost more in branches than it saves in distance computations.
+class PoseLibrary
+{
+public:
+	explicit PoseLibrary(const File& file)
+		: m_file(file, MemoryMappedFile::readOnly),
+		m_features(nullptr),
+		m_names(nullptr),
+		m_numPoses(0)
+	{
+		const uint8* data = static_cast<const uint8*>(m_file.getData());
+		const int64 size = (int64) m_file.getSize();
+
+		if (data == nullptr || size < PoseLibraryFormat::kHeaderSize || ByteOrder::isBigEndian())
+			return;
+
+		const int numPoses = (int) ByteOrder::littleEndianInt(data + 8);
+
+		if ((int) ByteOrder::littleEndianInt(data) != PoseLibraryFormat::kMagic
+			|| (int) ByteOrder::littleEndianInt(data + 4) != PoseLibraryFormat::kVersion
+			|| (int) ByteOrder::littleEndianInt(data + 12) != PoseFeatures::kNumFeatures
+			|| numPoses < 0
+			|| size != PoseLibraryFormat::kHeaderSize
+				+ numPoses * (int64) (PoseFeatures::kNumFeatures * sizeof(float) + PoseLibraryFormat::kNameSize))
+			return;
+
+		m_features = reinterpret_cast<const float*>(data + PoseLibraryFormat::kHeaderSize);
+		m_names = reinterpret_cast<const char*>(m_features + (size_t) numPoses * PoseFeatures::kNumFeatures);
+		m_numPoses = numPoses;
+	}
+
+	bool isValid() const      { return m_features != nullptr; }
+	int getNumPoses() const   { return m_numPoses; }
+
+	const float* getFeatures(int index) const
+	{
+		return m_features + (size_t) index * PoseFeatures::kNumFeatures;
+	}
+
+	String getName(int index) const
+	{
+		const char* name = m_names + (size_t) index * PoseLibraryFormat::kNameSize;
+		int length = 0;
+
+		while (length < PoseLibraryFormat::kNameSize && name[length] != 0)
+			++length;
+
+		return String::fromUTF8(name, length);
+	}
+
+	// The nearest poses to the given features, with their distances.
+	void findNearest(const float* features, PoseMatches& result) const
+	{
+		Nearest nearest;
+		int index = 0;
+
+#if VIRTUALHANDS_USE_SSE
+		__m128 query[PoseFeatures::kNumFeatures / 4];
+
+		for (int i = 0; i < PoseFeatures::kNumFeatures / 4; ++i)
+			query[i] = _mm_loadu_ps(features + i * 4);
+
+		// Four poses at a time, so one transpose sums all four. The first half of the
+		// features, mostly fingertips, already rules out most poses; the second half is
+		// only looked at when one of the four can still beat the worst match.
+		static_jassert(PoseFeatures::kNumFeatures == 32);
+
+		for (; index + 4 <= m_numPoses; index += 4)
+		{
+			const float* pose = getFeatures(index);
+			const __m128 worst = _mm_set1_ps(nearest.getWorst());
+			__m128 distances = sumFourPoses(query, pose);
+
+			if (_mm_movemask_ps(_mm_cmplt_ps(distances, worst)) == 0)
+				continue;
+
+			distances = _mm_add_ps(distances, sumFourPoses(query + 4, pose + 16));
+
+			if (_mm_movemask_ps(_mm_cmplt_ps(distances, worst)) != 0)
+			{
+				float candidates[4];
+				_mm_storeu_ps(candidates, distances);
+
+				for (int i = 0; i < 4; ++i)
+					nearest.add(candidates[i], index + i);
+			}
+		}
+#endif
+
+		for (; index < m_numPoses; ++index)
+			nearest.add(distanceSquared(features, getFeatures(index)), index);
+
+		result.numMatches = nearest.numBest;
+
+		for (int i = 0; i < nearest.numBest; ++i)
+		{
+			PoseMatch& match = result.matches[i];
+			match.index = nearest.indices[i];
+			match.distance = std::sqrt(nearest.distances[i]);
+
+			memcpy(match.name, m_names + (size_t) match.index * PoseLibraryFormat::kNameSize, sizeof(match.name));
+			match.name[sizeof(match.name) - 1] = 0;
+		}
+	}
+
+private:
+	// The best matches so far, nearest first.
+	struct Nearest
+	{
+		Nearest() : numBest(0) {}
+
+		float getWorst() const
+		{
+			return numBest < PoseMatches::kMaxMatches ? std::numeric_limits<float>::max() : distances[numBest - 1];
+		}
+
+		void add(float distance, int index)
+		{
+			if (distance >= getWorst())
+				return;
+
+			// Insert in order, dropping the furthest when full.
+			int slot = numBest < PoseMatches::kMaxMatches ? numBest++ : numBest - 1;
+
+			for (; slot > 0 && distances[slot - 1] > distance; --slot)
+			{
+				distances[slot] = distances[slot - 1];
+				indices[slot] = indices[slot - 1];
+			}
+
+			distances[slot] = distance;
+			indices[slot] = index;
+		}
+
+		float distances[PoseMatches::kMaxMatches];
+		int   indices[PoseMatches::kMaxMatches];
+		int   numBest;
+	};
+
+#if VIRTUALHANDS_USE_SSE
+	// Squared distances of four consecutive poses over one half of the features,
+	// four vectors of each. Written out so the query stays in registers.
+	static __m128 sumFourPoses(const __m128* query, const float* pose)
+	{
+		__m128 sums[4];
+
+		for (int p = 0; p < 4; ++p)
+		{
+			const float* features = pose + p * PoseFeatures::kNumFeatures;
+			const __m128 d0 = _mm_sub_ps(query[0], _mm_loadu_ps(features));
+			const __m128 d1 = _mm_sub_ps(query[1], _mm_loadu_ps(features + 4));
+			const __m128 d2 = _mm_sub_ps(query[2], _mm_loadu_ps(features + 8));
+			const __m128 d3 = _mm_sub_ps(query[3], _mm_loadu_ps(features + 12));
+
+			sums[p] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0, d0), _mm_mul_ps(d1, d1)),
+				_mm_add_ps(_mm_mul_ps(d2, d2), _mm_mul_ps(d3, d3)));
+		}
+
+		_MM_TRANSPOSE4_PS(sums[0], sums[1], sums[2], sums[3]);
+		return _mm_add_ps(_mm_add_ps(sums[0], sums[1]), _mm_add_ps(sums[2], sums[3]));
+	}
+#endif
+
+	// Four sums the compiler can keep in vector registers. Used for the poses
+	// left over after the last group of four, and for everything without SSE.
+	static float distanceSquared(const float* query, const float* pose)
+	{
+		float sums[4] = { 0, 0, 0, 0 };
+
+		for (int i = 0; i < PoseFeatures::kNumFeatures; i += 4)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				const float d = query[i + j] - pose[i + j];
+				sums[j] += d * d;
+			}
+		}
+
+		return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+	}
+
+	MemoryMappedFile m_file;
+	const float*     m_features;
+	const char*      m_names;
+	int              m_numPoses;
+};
+
+//==============================================================================
+// Builds pose library files. Poses of an existing library can be copied in, so
+// adding a pose means writing the whole library again.
+class PoseLibraryWriter
+{
+public:
+	void addPose(const String& name, const float* features)
+	{
+		m_features.insertArray(-1, features, PoseFeatures::kNumFeatures);
+		m_names.add(name);
+	}
+
+	void addPoses(const PoseLibrary& library)
+	{
+		for (int i = 0; i < library.getNumPoses(); ++i)
+			addPose(library.getName(i), library.getFeatures(i));
+	}
+
+	int getNumPoses() const { return m_names.size(); }
+
+	bool writeTo(const File& file) const
+	{
+		TemporaryFile temp(file);
+		ScopedPointer<FileOutputStream> stream(temp.getFile().createOutputStream());
+
+		if (stream == nullptr || stream->failedToOpen())
+			return false;
+
+		stream->writeInt(PoseLibraryFormat::kMagic);
+		stream->writeInt(PoseLibraryFormat::kVersion);
+		stream->writeInt(m_names.size());
+		stream->writeInt(PoseFeatures::kNumFeatures);
+
+		for (int i = 0; i < m_features.size(); ++i)
+			stream->writeFloat(m_features.getUnchecked(i));
+
+		for (int i = 0; i < m_names.size(); ++i)
+		{
+			char name[PoseLibraryFormat::kNameSize] = { 0 };
+			m_names[i].copyToUTF8(name, sizeof(name));
+			stream->write(name, sizeof(name));
+		}
+
+		stream = nullptr;
+		return temp.overwriteTargetFileWithTemporary();
+	}
+
+private:
+	Array<float> m_features;
+	StringArray  m_names;
+};
+
+#endif // VIRTUALHANDS_POSELIBRARY_H
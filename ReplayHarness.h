@@ -0,0 +1,486 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_REPLAYHARNESS_H
+#define VIRTUALHANDS_REPLAYHARNESS_H
+
+#include "HeadlessRenderer.h"
+#include "SyntheticHands.h"
+#include <algorithm>
+#include <cstdio>
+
+#if VIRTUALHANDS_HEADLESS
+
+//==============================================================================
+// What one session of the harness is allowed to cost. Zero means no limit.
+struct ReplayBudget
+{
+	enum Stage
+	{
+		kStage_Source,      // reading and decoding one recorded frame
+		kStage_Update,      // HandScene::update of one recorded frame: skeletons, demo physics and draw lists
+		kStage_Render,      // setupScene and submitting the draw lists
+		kStage_Finish,      // waiting for the GPU to finish the frame
+		kNumStages
+	};
+
+	ReplayBudget()
+		: syntheticHands(0),
+		syntheticFrames(0),
+		minFps(0),
+		peakRssMb(0)
+	{
+		for (int i = 0; i < kNumStages; ++i)
+			p99Ms[i] = 0;
+	}
+
+	static const char* getStageName(int stage)
+	{
+		static const char* const names[kNumStages] = { "source", "update", "render", "finish" };
+		return names[stage];
+	}
+
+	String name;
+	File   session;            // a recording, or none for synthetic hands
+	int    syntheticHands;
+	int    syntheticFrames;
+	double minFps;
+	double p99Ms[kNumStages];
+	double peakRssMb;
+};
+
+struct HarnessSettings
+{
+	HarnessSettings()
+		: width(640),
+		height(480),
+		fps(60),
+		hashInterval(60)
+	{}
+
+	File budgetsFile;
+	File reportFile;          // none to only log the results
+	File hashesFile;          // reference image hashes; written if it does not exist yet
+	int  width;
+	int  height;
+	int  fps;
+	int  hashInterval;        // frames between image hashes
+};
+
+//==============================================================================
+// Replays every session listed in a budgets file through the whole pipeline as fast
+// as it goes: frame source, HandScene::update (physics included) and offscreen
+// rendering. Each frame is finished on the GPU before the next one starts, so the
+// stage timings are latencies rather than queueing. Fails if any session misses a
+// budget, or if an image hash differs from the reference, which catches changes
+// to what is drawn. Hashes depend on the GL driver, so keep one reference per machine.
+class ReplayHarness : public Thread
+{
+public:
+	explicit ReplayHarness(const HarnessSettings& settings)
+		: Thread("ReplayHarness"),
+		m_settings(settings),
+		m_bSucceeded(false)
+	{}
+
+	~ReplayHarness()
+	{
+		stopThread(10000);
+	}
+
+	bool succeeded() const { return m_bSucceeded; }
+
+	void run()
+	{
+		m_bSucceeded = runSessions();
+
+		JUCEApplication::quit();
+	}
+
+private:
+	struct SessionResult
+	{
+		SessionResult() : numFrames(0), numUpdates(0), fps(0), peakRssMb(0) {}
+
+		int64       numFrames;     // rendered
+		int64       numUpdates;    // recorded frames passed to HandScene::update
+		double      fps;
+		double      p99Ms[ReplayBudget::kNumStages];
+		double      peakRssMb;
+		StringArray hashes;        // one per hash interval, hex
+		StringArray failures;
+	};
+
+	bool runSessions()
+	{
+		Array<ReplayBudget> budgets;
+
+		if (! readBudgets(budgets))
+			return fail("Could not read budgets from " + m_settings.budgetsFile.getFullPathName());
+
+		OffscreenGLContext context;
+
+		if (! context.create())
+			return fail("Could not create a surfaceless EGL context");
+
+		if (! HeadlessRenderer::initGLExtensions())
+			return fail("Framebuffer objects, pixel buffers and sync objects are required");
+
+		OffscreenFramebuffer framebuffer;
+
+		if (! framebuffer.create(m_settings.width, m_settings.height))
+			return fail("Could not create the offscreen framebuffer");
+
+		glViewport(0, 0, m_settings.width, m_settings.height);
+
+		const var referenceHashes(m_settings.hashesFile.existsAsFile() ? JSON::parse(m_settings.hashesFile) : var::null);
+		DynamicObject* pHashes = new DynamicObject();
+		var hashes(pHashes);
+		var sessionReports;
+		bool bAllPassed = true;
+
+		for (int i = 0; i < budgets.size() && ! threadShouldExit(); ++i)
+		{
+			const ReplayBudget& budget = budgets.getReference(i);
+			SessionResult result;
+
+			if (! replaySession(budget, result))
+				return false;
+
+			checkBudget(budget, result);
+
+			if (! referenceHashes.isVoid())
+				checkHashes(referenceHashes[Identifier(budget.name)], result);
+
+			var hashList;
+			for (int h = 0; h < result.hashes.size(); ++h)
+				hashList.append(result.hashes[h]);
+
+			pHashes->setProperty(Identifier(budget.name), hashList);
+			sessionReports.append(createReport(budget, result));
+			logResult(budget, result);
+
+			bAllPassed = bAllPassed && result.failures.size() == 0;
+		}
+
+		if (referenceHashes.isVoid() && m_settings.hashesFile != File::nonexistent)
+		{
+			m_settings.hashesFile.replaceWithText(JSON::toString(hashes));
+			Logger::writeToLog("Reference image hashes written to " + m_settings.hashesFile.getFullPathName());
+		}
+
+		if (m_settings.reportFile != File::nonexistent)
+		{
+			DynamicObject* pReport = new DynamicObject();
+			var report(pReport);
+			pReport->setProperty("renderer", String((const char*) glGetString(GL_RENDERER)));
+			pReport->setProperty("passed", bAllPassed);
+			pReport->setProperty("sessions", sessionReports);
+
+			m_settings.reportFile.replaceWithText(JSON::toString(report));
+		}
+
+		Logger::writeToLog(bAllPassed ? "Replay harness passed" : "Replay harness FAILED");
+		return bAllPassed;
+	}
+
+	bool replaySession(const ReplayBudget& budget, SessionResult& result)
+	{
+		// So the peak below belongs to this session, not to whichever ran before it.
+		resetPeakResident();
+
+		// Synthetic hands go through a session file too, so the frame source is the same.
+		ScopedPointer<TemporaryFile> syntheticSession;
+		File sessionFile(budget.session);
+
+		if (budget.syntheticHands > 0)
+		{
+			syntheticSession = new TemporaryFile(".vhs");
+			sessionFile = syntheticSession->getFile();
+			writeSyntheticSession(sessionFile, budget.syntheticHands, budget.syntheticFrames);
+		}
+
+		SessionReader replay(sessionFile);
+
+		if (! replay.isValid())
+			return fail("Could not read session " + sessionFile.getFullPathName());
+
+		HandScene scene;
+		const HandScene::ScopedGL sceneGL(scene);
+
+		LeapUtilGL::CameraGL camera;
+		camera.SetOrbitTarget(Leap::Vector::zero());
+		camera.SetPOVLookAt(Leap::Vector(0, 6, 10), camera.GetOrbitTarget());
+
+		Array<float> stageMs[ReplayBudget::kNumStages];
+		HeapBlock<uint8> pixels((size_t) m_settings.width * m_settings.height * 4);
+		FrameSnapshot frame;
+		const int64 startTicks = Time::getHighResolutionTicks();
+
+		for (int64 numFrames = 0; ! threadShouldExit(); ++numFrames)
+		{
+			const int64 sessionTime = numFrames * 1000000 / m_settings.fps;
+			bool bUpdated = false;
+
+			// Tracking runs faster than the render timestep, so every recorded frame due by
+			// now goes through update; only rendering happens at the fixed timestep.
+			for (;;)
+			{
+				const int64 sourceTicks = Time::getHighResolutionTicks();
+
+				if (! replay.readNextDue(sessionTime, frame))
+					break;
+
+				const int64 updateTicks = Time::getHighResolutionTicks();
+				scene.update(frame);
+
+				stageMs[ReplayBudget::kStage_Source].add(getMilliseconds(sourceTicks, updateTicks));
+				stageMs[ReplayBudget::kStage_Update].add(getMilliseconds(updateTicks, Time::getHighResolutionTicks()));
+				++result.numUpdates;
+				bUpdated = true;
+			}
+
+			if (! bUpdated && replay.isFinished())
+				break;
+
+			const int64 renderTicks = Time::getHighResolutionTicks();
+			scene.setupScene(camera, m_settings.width, m_settings.height);
+			scene.render(camera);
+
+			const int64 finishTicks = Time::getHighResolutionTicks();
+			glFinish();
+
+			stageMs[ReplayBudget::kStage_Render].add(getMilliseconds(renderTicks, finishTicks));
+			stageMs[ReplayBudget::kStage_Finish].add(getMilliseconds(finishTicks, Time::getHighResolutionTicks()));
+
+			if (numFrames % m_settings.hashInterval == 0)
+			{
+				glReadPixels(0, 0, m_settings.width, m_settings.height, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+				result.hashes.add(String::toHexString((int64) hashPixels(pixels, (size_t) m_settings.width * m_settings.height * 4)));
+			}
+
+			result.numFrames = numFrames + 1;
+		}
+
+		const double seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks);
+
+		result.fps = seconds > 0 ? result.numFrames / seconds : 0.0;
+		result.peakRssMb = getPeakResidentMegabytes();
+
+		for (int stage = 0; stage < ReplayBudget::kNumStages; ++stage)
+			result.p99Ms[stage] = getPercentile(stageMs[stage], 0.99);
+
+		return true;
+	}
+
+	void checkBudget(const ReplayBudget& budget, SessionResult& result) const
+	{
+		if (budget.minFps > 0 && result.fps < budget.minFps)
+			result.failures.add(String::formatted("%.1f fps is below the budget of %.1f", result.fps, budget.minFps));
+
+		for (int stage = 0; stage < ReplayBudget::kNumStages; ++stage)
+		{
+			if (budget.p99Ms[stage] > 0 && result.p99Ms[stage] > budget.p99Ms[stage])
+				result.failures.add(String::formatted("%s p99 of %.3f ms is over the budget of %.3f ms",
+					ReplayBudget::getStageName(stage), result.p99Ms[stage], budget.p99Ms[stage]));
+		}
+
+		if (budget.peakRssMb > 0 && result.peakRssMb > budget.peakRssMb)
+			result.failures.add(String::formatted("peak RSS of %.1f MB is over the budget of %.1f MB",
+				result.peakRssMb, budget.peakRssMb));
+	}
+
+	static void checkHashes(const var& reference, SessionResult& result)
+	{
+		if (! reference.isArray())
+		{
+			result.failures.add("no reference image hashes");
+			return;
+		}
+
+		if (reference.size() != result.hashes.size())
+			result.failures.add(String::formatted("%d image hashes, the reference has %d", result.hashes.size(), reference.size()));
+
+		for (int i = 0; i < jmin(reference.size(), result.hashes.size()); ++i)
+		{
+			if (reference[i].toString() != result.hashes[i])
+			{
+				result.failures.add("image hash " + String(i) + " differs from the reference");
+				break;
+			}
+		}
+	}
+
+	var createReport(const ReplayBudget& budget, const SessionResult& result) const
+	{
+		DynamicObject* pSession = new DynamicObject();
+		var session(pSession);
+		DynamicObject* pStages = new DynamicObject();
+
+		for (int stage = 0; stage < ReplayBudget::kNumStages; ++stage)
+			pStages->setProperty(ReplayBudget::getStageName(stage), result.p99Ms[stage]);
+
+		var failures;
+		for (int i = 0; i < result.failures.size(); ++i)
+			failures.append(result.failures[i]);
+
+		pSession->setProperty("name", budget.name);
+		pSession->setProperty("frames", result.numFrames);
+		pSession->setProperty("recordedFrames", result.numUpdates);
+		pSession->setProperty("fps", result.fps);
+		pSession->setProperty("p99Ms", var(pStages));
+		pSession->setProperty("peakRssMb", result.peakRssMb);
+		pSession->setProperty("failures", failures);
+		return session;
+	}
+
+	static void logResult(const ReplayBudget& budget, const SessionResult& result)
+	{
+		String line(budget.name + String::formatted(": %d frames from %d recorded, %.1f fps, p99",
+			(int) result.numFrames, (int) result.numUpdates, result.fps));
+
+		for (int stage = 0; stage < ReplayBudget::kNumStages; ++stage)
+			line << " " << ReplayBudget::getStageName(stage) << " " << String(result.p99Ms[stage], 3) << " ms";
+
+		line << ", peak RSS " << String(result.peakRssMb, 1) << " MB";
+		Logger::writeToLog(line);
+
+		for (int i = 0; i < result.failures.size(); ++i)
+			Logger::writeToLog("  FAILED: " + result.failures[i]);
+	}
+
+	//==============================================================================
+	bool readBudgets(Array<ReplayBudget>& budgets)
+	{
+		const var root(JSON::parse(m_settings.budgetsFile));
+		const var sessions(root[Identifier("sessions")]);
+
+		if (! sessions.isArray())
+			return false;
+
+		m_settings.width = getInt(root, "width", m_settings.width) & ~1;
+		m_settings.height = getInt(root, "height", m_settings.height) & ~1;
+		m_settings.fps = jmax(1, getInt(root, "fps", m_settings.fps));
+		m_settings.hashInterval = jmax(1, getInt(root, "hashInterval", m_settings.hashInterval));
+
+		for (int i = 0; i < sessions.size(); ++i)
+		{
+			const var session(sessions[i]);
+			const var p99(session[Identifier("p99Ms")]);
+			ReplayBudget budget;
+
+			budget.name = session[Identifier("name")].toString();
+			budget.syntheticHands = getInt(session, "syntheticHands", 0);
+			budget.syntheticFrames = getInt(session, "syntheticFrames", 1200);
+			budget.minFps = getDouble(session, "minFps", 0);
+			budget.peakRssMb = getDouble(session, "peakRssMb", 0);
+
+			if (budget.syntheticHands <= 0)
+				budget.session = m_settings.budgetsFile.getSiblingFile(session[Identifier("session")].toString());
+
+			for (int stage = 0; stage < ReplayBudget::kNumStages; ++stage)
+				budget.p99Ms[stage] = getDouble(p99, ReplayBudget::getStageName(stage), 0);
+
+			if (budget.name.isEmpty())
+				budget.name = budget.session.getFileName();
+
+			budgets.add(budget);
+		}
+
+		return budgets.size() > 0;
+	}
+
+	static int getInt(const var& object, const char* name, int defaultValue)
+	{
+		const var value(object[Identifier(name)]);
+		return value.isVoid() ? defaultValue : (int) value;
+	}
+
+	static double getDouble(const var& object, const char* name, double defaultValue)
+	{
+		const var value(object[Identifier(name)]);
+		return value.isVoid() ? defaultValue : (double) value;
+	}
+
+	static void writeSyntheticSession(const File& file, int numHands, int numFrames)
+	{
+		SessionWriter writer(file);
+		SyntheticHands hands(numHands, 1234);
+		FrameSnapshot frame;
+
+		for (int i = 0; i < numFrames; ++i)
+		{
+			hands.nextFrame(frame);
+			writer.writeFrame(frame);
+		}
+	}
+
+	// FNV-1a, stable across runs and platforms for the same pixels.
+	static uint64 hashPixels(const uint8* pixels, size_t numBytes)
+	{
+		uint64 hash = 14695981039346656037ULL;
+
+		for (size_t i = 0; i < numBytes; ++i)
+			hash = (hash ^ pixels[i]) * 1099511628211ULL;
+
+		return hash;
+	}
+
+	static float getMilliseconds(int64 startTicks, int64 endTicks)
+	{
+		return (float) (Time::highResolutionTicksToSeconds(endTicks - startTicks) * 1000.0);
+	}
+
+	static double getPercentile(Array<float>& values, double fraction)
+	{
+		if (values.size() == 0)
+			return 0.0;
+
+		// Nearest rank: the smallest value at least that fraction of the samples do not exceed.
+		std::sort(values.begin(), values.end());
+		return values[jlimit(0, values.size() - 1, (int) std::ceil(fraction * values.size()) - 1)];
+	}
+
+	// High water mark of the resident set since the last resetPeakResident().
+	static double getPeakResidentMegabytes()
+	{
+		StringArray lines;
+		lines.addLines(File("/proc/self/status").loadFileAsString());
+
+		for (int i = 0; i < lines.size(); ++i)
+		{
+			if (lines[i].startsWith("VmHWM:"))
+				return lines[i].fromFirstOccurrenceOf(":", false, false).trim().getLargeIntValue() / 1024.0;
+		}
+
+		return 0.0;
+	}
+
+	// Writing 5 to clear_refs lowers the process's VmHWM to its current resident set.
+	// Kernels before 4.0 ignore it, and the peak then covers every session so far.
+	static void resetPeakResident()
+	{
+		if (FILE* pFile = fopen("/proc/self/clear_refs", "w"))
+		{
+			fputs("5", pFile);
+			fclose(pFile);
+		}
+	}
+
+	static bool fail(const String& message)
+	{
+		Logger::writeToLog("Replay harness failed: " + message);
+		return false;
+	}
+
+	HarnessSettings m_settings;
+	bool            m_bSucceeded;
+};
+
+#endif // VIRTUALHANDS_HEADLESS
+
+#endif // VIRTUALHANDS_REPLAYHARNESS_H
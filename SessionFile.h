@@ -0,0 +1,699 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_SESSIONFILE_H
+#define VIRTUALHANDS_SESSIONFILE_H
+
+#include "HandSnapshot.h"
+
+//==============================================================================
+// A recorded session is a small header followed by one record per Leap frame,
+// written in the order the frames arrived, then an index of the key frames.
+//
+// Every kKeyFrameInterval-th record is a key frame that decodes on its own. The
+// others are deltas against the frame before them: each float is stored as the
+// XOR of its bits with the same field in the previous frame, as a variable length
+// integer, so values that barely changed take one or two bytes and decoding is exact.
+//
+// Seeking is a binary search of the index followed by at most
+// kKeyFrameInterval - 1 delta decodes.
+namespace SessionFormat
+{
+	const int kMagic            = 0x4e534856; // "VHSN"
+	const int kIndexMagic       = 0x58444e49; // "INDX"
+	const int kVersion          = 2;
+	const int kKeyFrameInterval = 64;
+	const int kHeaderSize       = 8;
+	const int kFooterSize       = 8 + 8 + 4 + 4;
+
+	enum RecordType
+	{
+		kRecord_KeyFrame   = 'K',
+		kRecord_DeltaFrame = 'D'
+	};
+
+	struct KeyFrameEntry
+	{
+		int64 timestamp;
+		int64 offset;
+		int64 frameNumber;
+	};
+
+	//==============================================================================
+	inline uint32 floatBits(float value)
+	{
+		uint32 bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline float bitsToFloat(uint32 bits)
+	{
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	inline void writeVarUInt(OutputStream& stream, uint64 value)
+	{
+		while (value >= 0x80)
+		{
+			stream.writeByte((char) ((value & 0x7f) | 0x80));
+			value >>= 7;
+		}
+
+		stream.writeByte((char) value);
+	}
+
+	inline void writeVarInt(OutputStream& stream, int64 value)
+	{
+		writeVarUInt(stream, ((uint64) value << 1) ^ (uint64) (value >> 63));
+	}
+
+	inline void writeFloat(OutputStream& stream, float value, float reference)
+	{
+		writeVarUInt(stream, floatBits(value) ^ floatBits(reference));
+	}
+
+	inline void writeVector(OutputStream& stream, const Leap::Vector& v, const Leap::Vector& reference)
+	{
+		writeFloat(stream, v.x, reference.x);
+		writeFloat(stream, v.y, reference.y);
+		writeFloat(stream, v.z, reference.z);
+	}
+
+	// Hands and fingers are delta coded against the same slot of the reference
+	// frame when the ids match, and against zeros otherwise.
+	inline void encodeFrame(OutputStream& stream, const FrameSnapshot& frame, const FrameSnapshot& reference)
+	{
+		static const HandSnapshot   emptyHand;
+		static const FingerSnapshot emptyFinger;
+
+		writeVarInt(stream, frame.id - reference.id);
+		writeVarInt(stream, frame.timestamp - reference.timestamp);
+		writeVarUInt(stream, (uint64) frame.numHands);
+
+		for (int handCount = 0; handCount < frame.numHands; ++handCount)
+		{
+			const HandSnapshot& hand = frame.hands[handCount];
+			const HandSnapshot& refHand = (handCount < reference.numHands && reference.hands[handCount].id == hand.id)
+				? reference.hands[handCount] : emptyHand;
+
+			writeVarInt(stream, hand.id);
+			writeVarInt(stream, hand.thumbId);
+			writeFloat(stream, hand.sphereRadius, refHand.sphereRadius);
+			writeVector(stream, hand.palmPosition, refHand.palmPosition);
+			writeVector(stream, hand.palmNormal, refHand.palmNormal);
+			writeVector(stream, hand.direction, refHand.direction);
+			writeVarUInt(stream, (uint64) hand.numFingers);
+
+			for (int fingerCount = 0; fingerCount < hand.numFingers; ++fingerCount)
+			{
+				const FingerSnapshot& finger = hand.fingers[fingerCount];
+				const FingerSnapshot& refFinger = (fingerCount < refHand.numFingers && refHand.fingers[fingerCount].id == finger.id)
+					? refHand.fingers[fingerCount] : emptyFinger;
+
+				writeVarInt(stream, finger.id);
+				writeFloat(stream, finger.length, refFinger.length);
+				writeVector(stream, finger.tipPosition, refFinger.tipPosition);
+				writeVector(stream, finger.stabilizedTipPosition, refFinger.stabilizedTipPosition);
+				writeVector(stream, finger.tipVelocity, refFinger.tipVelocity);
+				writeVector(stream, finger.direction, refFinger.direction);
+			}
+		}
+	}
+
+	//==============================================================================
+	// Reads from a block of memory, normally the memory mapped session file.
+	// Running past the end sets a flag instead of reading out of bounds.
+	class Decoder
+	{
+	public:
+		Decoder(const uint8* data, const uint8* end)
+			: m_data(data),
+			m_end(end),
+			m_bFailed(false)
+		{}
+
+		bool failed() const          { return m_bFailed; }
+		const uint8* getData() const { return m_data; }
+
+		uint8 readByte()
+		{
+			if (m_data >= m_end)
+			{
+				m_bFailed = true;
+				return 0;
+			}
+
+			return *m_data++;
+		}
+
+		uint64 readVarUInt()
+		{
+			uint64 value = 0;
+
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				const uint8 byte = readByte();
+				value |= (uint64) (byte & 0x7f) << shift;
+
+				if ((byte & 0x80) == 0)
+					return value;
+			}
+
+			m_bFailed = true;
+			return 0;
+		}
+
+		int64 readVarInt()
+		{
+			const uint64 value = readVarUInt();
+			return (int64) (value >> 1) ^ -(int64) (value & 1);
+		}
+
+		float readFloat(float reference)
+		{
+			return bitsToFloat((uint32) readVarUInt() ^ floatBits(reference));
+		}
+
+		Leap::Vector readVector(const Leap::Vector& reference)
+		{
+			Leap::Vector v;
+			v.x = readFloat(reference.x);
+			v.y = readFloat(reference.y);
+			v.z = readFloat(reference.z);
+			return v;
+		}
+
+		int64 readInt64()
+		{
+			int64 value = 0;
+
+			for (int i = 0; i < 8; ++i)
+				value |= (int64) readByte() << (i * 8);
+
+			return value;
+		}
+
+	private:
+		const uint8* m_data;
+		const uint8* m_end;
+		bool         m_bFailed;
+	};
+
+	// frame and reference must not be the same object.
+	inline bool decodeFrame(Decoder& decoder, const FrameSnapshot& reference, FrameSnapshot& frame)
+	{
+		static const HandSnapshot   emptyHand;
+		static const FingerSnapshot emptyFinger;
+
+		frame.id        = reference.id + decoder.readVarInt();
+		frame.timestamp = reference.timestamp + decoder.readVarInt();
+		// Checked before narrowing, so a corrupt count can't wrap to a negative or small one.
+		const uint64 numHands = decoder.readVarUInt();
+
+		if (numHands > (uint64) FrameSnapshot::kMaxHands)
+			return false;
+
+		frame.numHands = (int32) numHands;
+
+		for (int handCount = 0; handCount < frame.numHands; ++handCount)
+		{
+			HandSnapshot& hand = frame.hands[handCount];
+
+			hand.id = (int32) decoder.readVarInt();
+
+			const HandSnapshot& refHand = (handCount < reference.numHands && reference.hands[handCount].id == hand.id)
+				? reference.hands[handCount] : emptyHand;
+
+			hand.thumbId      = (int32) decoder.readVarInt();
+			hand.sphereRadius = decoder.readFloat(refHand.sphereRadius);
+			hand.palmPosition = decoder.readVector(refHand.palmPosition);
+			hand.palmNormal   = decoder.readVector(refHand.palmNormal);
+			hand.direction    = decoder.readVector(refHand.direction);
+
+			const uint64 numFingers = decoder.readVarUInt();
+
+			if (numFingers > (uint64) HandSnapshot::kMaxFingers)
+				return false;
+
+			hand.numFingers = (int32) numFingers;
+
+			for (int fingerCount = 0; fingerCount < hand.numFingers; ++fingerCount)
+			{
+				FingerSnapshot& finger = hand.fingers[fingerCount];
+
+				finger.id = (int32) decoder.readVarInt();
+
+				const FingerSnapshot& refFinger = (fingerCount < refHand.numFingers && refHand.fingers[fingerCount].id == finger.id)
+					? refHand.fingers[fingerCount] : emptyFinger;
+
+				finger.length                = decoder.readFloat(refFinger.length);
+				finger.tipPosition           = decoder.readVector(refFinger.tipPosition);
+				finger.stabilizedTipPosition = decoder.readVector(refFinger.stabilizedTipPosition);
+				finger.tipVelocity           = decoder.readVector(refFinger.tipVelocity);
+				finger.direction             = decoder.readVector(refFinger.direction);
+			}
+		}
+
+		return ! decoder.failed();
+	}
+}
+
+//==============================================================================
+class SessionWriter
+{
+public:
+	explicit SessionWriter(const File& file)
+		: m_numFrames(0)
+	{
+		file.deleteFile();
+		m_stream = new FileOutputStream(file, 1 << 16);
+
+		if (m_stream->failedToOpen())
+		{
+			m_stream = nullptr;
+			return;
+		}
+
+		m_stream->writeInt(SessionFormat::kMagic);
+		m_stream->writeInt(SessionFormat::kVersion);
+	}
+
+	~SessionWriter()
+	{
+		close();
+	}
+
+	bool isOpen() const { return m_stream != nullptr; }
+
+	void writeFrame(const FrameSnapshot& frame)
+	{
+		if (m_stream == nullptr)
+			return;
+
+		const bool bKeyFrame = (m_numFrames % SessionFormat::kKeyFrameInterval) == 0;
+
+		if (bKeyFrame)
+		{
+			SessionFormat::KeyFrameEntry entry;
+			entry.timestamp   = frame.timestamp;
+			entry.offset      = m_stream->getPosition();
+			entry.frameNumber = m_numFrames;
+			m_index.add(entry);
+		}
+
+		m_record.reset();
+		SessionFormat::encodeFrame(m_record, frame, bKeyFrame ? FrameSnapshot() : m_previous);
+
+		m_stream->writeByte((char) (bKeyFrame ? SessionFormat::kRecord_KeyFrame : SessionFormat::kRecord_DeltaFrame));
+		SessionFormat::writeVarUInt(*m_stream, m_record.getDataSize());
+		m_stream->write(m_record.getData(), m_record.getDataSize());
+
+		m_previous = frame;
+		++m_numFrames;
+	}
+
+	// Writes the key frame index. Files that were never closed are still
+	// readable, the reader then rebuilds the index by scanning the records.
+	void close()
+	{
+		if (m_stream == nullptr)
+			return;
+
+		const int64 indexOffset = m_stream->getPosition();
+
+		for (int i = 0; i < m_index.size(); ++i)
+		{
+			const SessionFormat::KeyFrameEntry& entry = m_index.getReference(i);
+			m_stream->writeInt64(entry.timestamp);
+			m_stream->writeInt64(entry.offset);
+			m_stream->writeInt64(entry.frameNumber);
+		}
+
+		m_stream->writeInt64(indexOffset);
+		m_stream->writeInt64(m_numFrames);
+		m_stream->writeInt(m_index.size());
+		m_stream->writeInt(SessionFormat::kIndexMagic);
+		m_stream = nullptr;
+	}
+
+private:
+	ScopedPointer<FileOutputStream>     m_stream;
+	MemoryOutputStream                  m_record;
+	FrameSnapshot                       m_previous;
+	int64                               m_numFrames;
+	Array<SessionFormat::KeyFrameEntry> m_index;
+};
+
+//==============================================================================
+// Random access to a recorded session through a memory mapping.
+// Session time is in microseconds, starting at the first recorded frame.
+class SessionReader
+{
+public:
+	explicit SessionReader(const File& file)
+		: m_file(file, MemoryMappedFile::readOnly),
+		m_data(static_cast<const uint8*>(m_file.getData())),
+		m_size((int64) m_file.getSize()),
+		m_recordsEnd(0),
+		m_numFrames(0),
+		m_startTime(0),
+		m_endTime(0),
+		m_offset(0),
+		m_frameNumber(-1),
+		m_bHasPeek(false),
+		m_peekOffset(0)
+	{
+		if (m_data == nullptr || m_size < SessionFormat::kHeaderSize)
+			return;
+
+		if (readInt32(m_data) != SessionFormat::kMagic
+			|| readInt32(m_data + 4) != SessionFormat::kVersion)
+			return;
+
+		if (! readIndex())
+			scanIndex();
+
+		if (m_index.size() > 0)
+		{
+			m_startTime = m_index.getReference(0).timestamp;
+			findEndTime();
+			rewind();
+		}
+	}
+
+	bool isValid() const        { return m_numFrames > 0; }
+	int64 getNumFrames() const  { return m_numFrames; }
+	int64 getDuration() const   { return m_endTime - m_startTime; }
+
+	// Frame number of the frame last handed out, -1 before the first.
+	int64 getFrameNumber() const { return m_frameNumber; }
+
+	// Session time of the frame last handed out.
+	int64 getTime() const        { return m_frameNumber >= 0 ? m_current.timestamp - m_startTime : 0; }
+
+	// True once every recorded frame has been handed out.
+	bool isFinished() const      { return m_frameNumber + 1 >= m_numFrames; }
+
+	bool readNext(FrameSnapshot& frame)
+	{
+		if (! peek())
+			return false;
+
+		commitPeek();
+		frame = m_current;
+		return true;
+	}
+
+	// Reads the next recorded frame if it is at or before sessionTime, for callers
+	// that need every frame rather than the latest one.
+	bool readNextDue(int64 sessionTime, FrameSnapshot& frame)
+	{
+		if (! peek() || m_peek.timestamp - m_startTime > sessionTime)
+			return false;
+
+		commitPeek();
+		frame = m_current;
+		return true;
+	}
+
+	// Moves forward to the last recorded frame at or before sessionTime.
+	// Returns false if no frame is due yet, leaving frame untouched.
+	bool advanceTo(int64 sessionTime, FrameSnapshot& frame)
+	{
+		bool bAdvanced = false;
+
+		while (peek() && m_peek.timestamp - m_startTime <= sessionTime)
+		{
+			commitPeek();
+			bAdvanced = true;
+		}
+
+		if (bAdvanced)
+			frame = m_current;
+
+		return bAdvanced;
+	}
+
+	// Jumps to the last frame at or before sessionTime, or the first frame if it comes before that.
+	bool seekToTime(int64 sessionTime, FrameSnapshot& frame)
+	{
+		if (! isValid())
+			return false;
+
+		const int64 timestamp = m_startTime + jmax((int64) 0, sessionTime);
+
+		// Keep decoding forward if the target is close ahead, otherwise restart from the nearest key frame.
+		if (m_frameNumber < 0 || timestamp < m_current.timestamp
+			|| findKeyFrameByTime(timestamp) > findKeyFrameByFrame(m_frameNumber))
+		{
+			startAtKeyFrame(findKeyFrameByTime(timestamp));
+
+			if (! readNext(frame))
+				return false;
+		}
+
+		advanceTo(timestamp - m_startTime, frame);
+		frame = m_current;
+		return true;
+	}
+
+	bool seekToFrame(int64 frameNumber, FrameSnapshot& frame)
+	{
+		if (! isValid())
+			return false;
+
+		frameNumber = jlimit((int64) 0, m_numFrames - 1, frameNumber);
+
+		if (m_frameNumber < 0 || frameNumber < m_frameNumber
+			|| findKeyFrameByFrame(frameNumber) > findKeyFrameByFrame(m_frameNumber))
+		{
+			startAtKeyFrame(findKeyFrameByFrame(frameNumber));
+		}
+
+		while (m_frameNumber < frameNumber)
+		{
+			if (! readNext(frame))
+				return false;
+		}
+
+		frame = m_current;
+		return true;
+	}
+
+	void rewind()
+	{
+		startAtKeyFrame(0);
+	}
+
+private:
+	static int32 readInt32(const uint8* data)
+	{
+		return (int32) ((uint32) data[0] | ((uint32) data[1] << 8) | ((uint32) data[2] << 16) | ((uint32) data[3] << 24));
+	}
+
+	bool readIndex()
+	{
+		if (m_size < SessionFormat::kHeaderSize + SessionFormat::kFooterSize)
+			return false;
+
+		const uint8* footer = m_data + m_size - SessionFormat::kFooterSize;
+		SessionFormat::Decoder decoder(footer, m_data + m_size);
+
+		const int64 indexOffset = decoder.readInt64();
+		const int64 numFrames   = decoder.readInt64();
+		const int   numEntries  = readInt32(footer + 16);
+		const int   magic       = readInt32(footer + 20);
+
+		if (magic != SessionFormat::kIndexMagic || numEntries <= 0
+			|| indexOffset < SessionFormat::kHeaderSize
+			|| indexOffset + (int64) numEntries * 24 != m_size - SessionFormat::kFooterSize)
+			return false;
+
+		decoder = SessionFormat::Decoder(m_data + indexOffset, footer);
+		m_index.ensureStorageAllocated(numEntries);
+
+		int64 previousOffset = SessionFormat::kHeaderSize - 1;
+		int64 previousFrameNumber = 0;
+
+		for (int i = 0; i < numEntries; ++i)
+		{
+			SessionFormat::KeyFrameEntry entry;
+			entry.timestamp   = decoder.readInt64();
+			entry.offset      = decoder.readInt64();
+			entry.frameNumber = decoder.readInt64();
+
+			// Offsets are decoded from directly, so anything outside the records
+			// or out of order means the index can't be trusted and gets rebuilt.
+			if (entry.offset <= previousOffset || entry.offset >= indexOffset
+				|| entry.frameNumber < previousFrameNumber || entry.frameNumber >= numFrames)
+			{
+				m_index.clear();
+				return false;
+			}
+
+			previousOffset = entry.offset;
+			previousFrameNumber = entry.frameNumber;
+			m_index.add(entry);
+		}
+
+		m_recordsEnd = indexOffset;
+		m_numFrames  = numFrames;
+		return ! decoder.failed();
+	}
+
+	// Rebuilds the index of a session that was not closed properly. Only key
+	// frame headers are decoded, every other record is skipped by its size.
+	void scanIndex()
+	{
+		m_index.clear();
+		m_numFrames = 0;
+
+		const uint8* end = m_data + m_size;
+		SessionFormat::Decoder decoder(m_data + SessionFormat::kHeaderSize, end);
+
+		for (;;)
+		{
+			const int64 offset = decoder.getData() - m_data;
+			const uint8 type   = decoder.readByte();
+			const uint64 size  = decoder.readVarUInt();
+			const uint8* record = decoder.getData();
+
+			if (decoder.failed() || (uint64) (end - record) < size
+				|| (type != SessionFormat::kRecord_KeyFrame && type != SessionFormat::kRecord_DeltaFrame)
+				|| (m_numFrames == 0 && type != SessionFormat::kRecord_KeyFrame))
+				break;
+
+			if (type == SessionFormat::kRecord_KeyFrame)
+			{
+				SessionFormat::Decoder keyFrame(record, record + size);
+				keyFrame.readVarInt();
+
+				SessionFormat::KeyFrameEntry entry;
+				entry.timestamp   = keyFrame.readVarInt();
+				entry.offset      = offset;
+				entry.frameNumber = m_numFrames;
+				m_index.add(entry);
+			}
+
+			m_recordsEnd = (record + size) - m_data;
+			++m_numFrames;
+			decoder = SessionFormat::Decoder(record + (size_t) size, end);
+		}
+	}
+
+	void findEndTime()
+	{
+		FrameSnapshot frame;
+		seekToFrame(m_numFrames - 1, frame);
+		m_endTime = frame.timestamp;
+	}
+
+	// Index of the last key frame at or before the given timestamp.
+	int findKeyFrameByTime(int64 timestamp) const
+	{
+		int lo = 0, hi = m_index.size() - 1;
+
+		while (lo < hi)
+		{
+			const int mid = (lo + hi + 1) / 2;
+
+			if (m_index.getReference(mid).timestamp <= timestamp)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+
+		return lo;
+	}
+
+	int findKeyFrameByFrame(int64 frameNumber) const
+	{
+		int lo = 0, hi = m_index.size() - 1;
+
+		while (lo < hi)
+		{
+			const int mid = (lo + hi + 1) / 2;
+
+			if (m_index.getReference(mid).frameNumber <= frameNumber)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+
+		return lo;
+	}
+
+	void startAtKeyFrame(int keyFrame)
+	{
+		const SessionFormat::KeyFrameEntry& entry = m_index.getReference(keyFrame);
+
+		m_offset      = entry.offset;
+		m_frameNumber = entry.frameNumber - 1;
+		m_current     = FrameSnapshot();
+		m_bHasPeek    = false;
+	}
+
+	// Decodes the record after the current one without moving past it.
+	bool peek()
+	{
+		if (m_bHasPeek)
+			return true;
+
+		if (isFinished() || m_offset >= m_recordsEnd)
+			return false;
+
+		const uint8* end = m_data + m_recordsEnd;
+		SessionFormat::Decoder decoder(m_data + m_offset, end);
+
+		const uint8 type  = decoder.readByte();
+		const uint64 size = decoder.readVarUInt();
+		const uint8* record = decoder.getData();
+
+		if (decoder.failed() || (uint64) (end - record) < size)
+			return false;
+
+		SessionFormat::Decoder frameDecoder(record, record + (size_t) size);
+		static const FrameSnapshot emptyFrame;
+
+		if (! SessionFormat::decodeFrame(frameDecoder,
+			type == SessionFormat::kRecord_KeyFrame ? emptyFrame : m_current, m_peek))
+			return false;
+
+		m_peekOffset = (record + size) - m_data;
+		m_bHasPeek = true;
+		return true;
+	}
+
+	void commitPeek()
+	{
+		m_current = m_peek;
+		m_offset = m_peekOffset;
+		m_bHasPeek = false;
+		++m_frameNumber;
+	}
+
+	MemoryMappedFile                    m_file;
+	const uint8*                        m_data;
+	int64                               m_size;
+	int64                               m_recordsEnd;
+	Array<SessionFormat::KeyFrameEntry> m_index;
+	int64                               m_numFrames;
+	int64                               m_startTime;
+	int64                               m_endTime;
+
+	int64                               m_offset;      // start of the record after m_current
+	int64                               m_frameNumber;
+	FrameSnapshot                       m_current;
+	bool                                m_bHasPeek;
+	FrameSnapshot                       m_peek;
+	int64                               m_peekOffset;
+};
+
+#endif // VIRTUALHANDS_SESSIONFILE_H
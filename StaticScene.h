@@ -0,0 +1,490 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_STATICSCENE_H
+#define VIRTUALHANDS_STATICSCENE_H
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "Leap.h"
+#include <algorithm>
+#include <cfloat>
+
+//==============================================================================
+// Environments are authored as JSON and compiled once into an index file that is
+// used straight from a memory mapping, so loading does no parsing and no allocation:
+//
+//   header      magic, version, numMaterials, numProps, numNodes, 3 reserved   int32 each
+//   materials   Material[numMaterials]
+//   props       Prop[numProps], in the order the tree leaves reference them
+//   nodes       Node[numNodes], a bounding volume hierarchy in depth first order
+//
+// Everything is little endian and every section starts 16 byte aligned.
+namespace StaticSceneFormat
+{
+	const int kMagic        = 0x43534856; // "VHSC"
+	const int kVersion      = 1;
+	const int kHeaderSize   = 32;
+	const int kMaxLeafProps = 8;
+	const int kMaxDepth     = 64;
+
+	enum Shape
+	{
+		kShape_Box,     // unit cube around the origin
+		kShape_Sphere,  // unit diameter sphere around the origin
+		kNumShapes
+	};
+
+	struct Material
+	{
+		float colour[4];
+	};
+
+	struct Prop
+	{
+		float transform[16];   // column major model matrix, as glMultMatrixf takes it
+		float centre[3];       // bounding sphere
+		float radius;
+		int32 material;
+		int32 shape;
+		int32 reserved[2];
+	};
+
+	// Leaves have numProps > 0 and hold props [first, first + numProps). Inner nodes
+	// have numProps == 0; their first child follows them, first is the second child.
+	struct Node
+	{
+		float boundsMin[3];
+		int32 first;
+		float boundsMax[3];
+		int32 numProps;
+	};
+}
+
+//==============================================================================
+// Props that never move, read from an index file through a memory mapping.
+// The tree serves both culling and proximity queries.
+class StaticScene
+{
+public:
+	explicit StaticScene(const File& file)
+		: m_file(file, MemoryMappedFile::readOnly),
+		m_materials(nullptr),
+		m_props(nullptr),
+		m_nodes(nullptr),
+		m_numMaterials(0),
+		m_numProps(0),
+		m_numNodes(0)
+	{
+		using namespace StaticSceneFormat;
+
+		const uint8* data = static_cast<const uint8*>(m_file.getData());
+		const int64 size = (int64) m_file.getSize();
+
+		if (data == nullptr || size < kHeaderSize || ByteOrder::isBigEndian())
+			return;
+
+		const int numMaterials = (int) ByteOrder::littleEndianInt(data + 8);
+		const int numProps     = (int) ByteOrder::littleEndianInt(data + 12);
+		const int numNodes     = (int) ByteOrder::littleEndianInt(data + 16);
+
+		if ((int) ByteOrder::littleEndianInt(data) != kMagic
+			|| (int) ByteOrder::littleEndianInt(data + 4) != kVersion
+			|| numMaterials < 0 || numProps < 0 || numNodes < 0
+			|| size != kHeaderSize + numMaterials * (int64) sizeof(Material)
+				+ numProps * (int64) sizeof(Prop) + numNodes * (int64) sizeof(Node))
+			return;
+
+		const Material* materials = reinterpret_cast<const Material*>(data + kHeaderSize);
+		const Prop* props = reinterpret_cast<const Prop*>(materials + numMaterials);
+		const Node* nodes = reinterpret_cast<const Node*>(props + numProps);
+
+		// The queries index straight into the mapping, so a corrupt file is
+		// rejected here rather than read out of bounds later.
+		for (int i = 0; i < numProps; ++i)
+		{
+			if (props[i].material < 0 || props[i].material >= numMaterials
+				|| props[i].shape < 0 || props[i].shape >= kNumShapes)
+				return;
+		}
+
+		int numVisited = 0;
+
+		if (numNodes > 0 && ! isValidNode(nodes, numNodes, numProps, 0, 0, numVisited))
+			return;
+
+		m_materials = materials;
+		m_props = props;
+		m_nodes = nodes;
+
+		m_numMaterials = numMaterials;
+		m_numProps = numProps;
+		m_numNodes = numNodes;
+	}
+
+	bool isValid() const          { return m_props != nullptr; }
+	int getNumMaterials() const   { return m_numMaterials; }
+	int getNumProps() const       { return m_numProps; }
+
+	const StaticSceneFormat::Material& getMaterial(int index) const  { return m_materials[index]; }
+	const StaticSceneFormat::Prop& getProp(int index) const          { return m_props[index]; }
+
+	// Every prop the frustum can see. The frustum needs classify and isVisible, as
+	// ViewFrustum has; nodes wholly inside it are taken without testing their props.
+	template <class FrustumType>
+	void findVisible(const FrustumType& frustum, Array<int>& props) const
+	{
+		props.clearQuick();
+
+		if (m_numNodes == 0)
+			return;
+
+		// Nodes known to be wholly inside are pushed as ~index.
+		int stack[StaticSceneFormat::kMaxDepth * 2];
+		int depth = 0;
+		stack[depth++] = 0;
+
+		while (depth > 0)
+		{
+			const int entry = stack[--depth];
+			const int nodeIndex = entry < 0 ? ~entry : entry;
+			const StaticSceneFormat::Node& node = m_nodes[nodeIndex];
+			bool bInside = entry < 0;
+
+			if (!bInside)
+			{
+				const Leap::Vector boundsMin(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]);
+				const Leap::Vector boundsMax(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]);
+				const int containment = frustum.classify((boundsMin + boundsMax) / 2, boundsMin.distanceTo(boundsMax) / 2);
+
+				if (containment == FrustumType::kOutside)
+					continue;
+
+				bInside = containment == FrustumType::kInside;
+			}
+
+			if (node.numProps > 0)
+			{
+				for (int i = node.first; i < node.first + node.numProps; ++i)
+				{
+					const StaticSceneFormat::Prop& prop = m_props[i];
+
+					if (bInside || frustum.isVisible(Leap::Vector(prop.centre[0], prop.centre[1], prop.centre[2]), prop.radius))
+						props.add(i);
+				}
+			}
+			else if (depth + 2 <= StaticSceneFormat::kMaxDepth * 2)
+			{
+				stack[depth++] = bInside ? ~node.first : node.first;
+				stack[depth++] = bInside ? ~(nodeIndex + 1) : nodeIndex + 1;
+			}
+		}
+	}
+
+	// Props whose bounding sphere comes within radius of the point, for fingertips.
+	void findPropsNear(const Leap::Vector& point, float radius, Array<int>& props) const
+	{
+		props.clearQuick();
+
+		if (m_numNodes == 0)
+			return;
+
+		int stack[StaticSceneFormat::kMaxDepth * 2];
+		int depth = 0;
+		stack[depth++] = 0;
+
+		while (depth > 0)
+		{
+			const int nodeIndex = stack[--depth];
+			const StaticSceneFormat::Node& node = m_nodes[nodeIndex];
+
+			if (distanceSquaredToBox(point, node) > radius * radius)
+				continue;
+
+			if (node.numProps > 0)
+			{
+				for (int i = node.first; i < node.first + node.numProps; ++i)
+				{
+					const StaticSceneFormat::Prop& prop = m_props[i];
+					const float reach = radius + prop.radius;
+
+					if (Leap::Vector(prop.centre[0], prop.centre[1], prop.centre[2]).distanceTo(point) <= reach)
+						props.add(i);
+				}
+			}
+			else if (depth + 2 <= StaticSceneFormat::kMaxDepth * 2)
+			{
+				stack[depth++] = node.first;
+				stack[depth++] = nodeIndex + 1;
+			}
+		}
+	}
+
+private:
+	// Children and prop ranges in bounds and at most kMaxDepth levels. Each node of
+	// a proper tree is reached once, so counting visits also stops shared subtrees.
+	static bool isValidNode(const StaticSceneFormat::Node* nodes, int numNodes, int numProps,
+		int nodeIndex, int level, int& numVisited)
+	{
+		const StaticSceneFormat::Node& node = nodes[nodeIndex];
+
+		if (level >= StaticSceneFormat::kMaxDepth || ++numVisited > numNodes)
+			return false;
+
+		if (node.numProps > 0)
+			return node.first >= 0 && node.first + (int64) node.numProps <= numProps;
+
+		return node.numProps == 0
+			&& node.first > nodeIndex + 1 && node.first < numNodes
+			&& isValidNode(nodes, numNodes, numProps, nodeIndex + 1, level + 1, numVisited)
+			&& isValidNode(nodes, numNodes, numProps, node.first, level + 1, numVisited);
+	}
+
+	static float distanceSquaredToBox(const Leap::Vector& point, const StaticSceneFormat::Node& node)
+	{
+		float distanceSquared = 0;
+
+		for (unsigned int axis = 0; axis < 3; ++axis)
+		{
+			const float below = node.boundsMin[axis] - point[axis];
+			const float above = point[axis] - node.boundsMax[axis];
+			const float outside = jmax(0.0f, below, above);
+			distanceSquared += outside * outside;
+		}
+
+		return distanceSquared;
+	}
+
+	MemoryMappedFile                    m_file;
+	const StaticSceneFormat::Material*  m_materials;
+	const StaticSceneFormat::Prop*      m_props;
+	const StaticSceneFormat::Node*      m_nodes;
+	int                                 m_numMaterials;
+	int                                 m_numProps;
+	int                                 m_numNodes;
+};
+
+//==============================================================================
+// Builds the index file, either from props added in code or from a JSON scene:
+//
+//   { "materials": [ [r, g, b, a], ... ],
+//     "props": [ { "shape": "box" or "sphere", "material": 0,
+//                  "position": [x, y, z], "scale": [x, y, z], "yaw": degrees }, ... ] }
+//
+// The tree splits the longest axis of the prop centres at the median, so it stays
+// balanced and its depth is about log2(numProps / kMaxLeafProps).
+class StaticSceneBuilder
+{
+public:
+	int addMaterial(float r, float g, float b, float a = 1.0f)
+	{
+		StaticSceneFormat::Material material;
+		material.colour[0] = r;
+		material.colour[1] = g;
+		material.colour[2] = b;
+		material.colour[3] = a;
+
+		m_materials.add(material);
+		return m_materials.size() - 1;
+	}
+
+	void addProp(StaticSceneFormat::Shape shape, int material, const Leap::Matrix& transform)
+	{
+		StaticSceneFormat::Prop prop;
+		zerostruct(prop);
+		memcpy(prop.transform, transform.toArray4x4().m_array, sizeof(prop.transform));
+
+		// Unit boxes and spheres both fit in a sphere of radius sqrt(3)/2 before scaling.
+		prop.centre[0] = transform.origin.x;
+		prop.centre[1] = transform.origin.y;
+		prop.centre[2] = transform.origin.z;
+		prop.radius = 0.8660254f * jmax(transform.xBasis.magnitude(), transform.yBasis.magnitude(), transform.zBasis.magnitude());
+		prop.material = material;
+		prop.shape = shape;
+
+		m_props.add(prop);
+	}
+
+	int getNumProps() const { return m_props.size(); }
+
+	bool loadJSON(const File& file)
+	{
+		const var root(JSON::parse(file));
+		const var materials(root[Identifier("materials")]);
+		const var props(root[Identifier("props")]);
+
+		if (!materials.isArray() || !props.isArray())
+			return false;
+
+		for (int i = 0; i < materials.size(); ++i)
+		{
+			const var colour(materials[i]);
+			addMaterial(getFloat(colour, 0, 1), getFloat(colour, 1, 1), getFloat(colour, 2, 1), getFloat(colour, 3, 1));
+		}
+
+		for (int i = 0; i < props.size(); ++i)
+		{
+			const var prop(props[i]);
+			const var position(prop[Identifier("position")]);
+			const var scale(prop[Identifier("scale")]);
+			const float yaw = (float) (double) prop[Identifier("yaw")] * 0.0174532925f;
+
+			const int material = jlimit(0, jmax(0, m_materials.size() - 1), (int) prop[Identifier("material")]);
+			const StaticSceneFormat::Shape shape = prop[Identifier("shape")].toString().equalsIgnoreCase("sphere")
+				? StaticSceneFormat::kShape_Sphere : StaticSceneFormat::kShape_Box;
+
+			Leap::Matrix transform(Leap::Vector::yAxis(), yaw,
+				Leap::Vector(getFloat(position, 0, 0), getFloat(position, 1, 0), getFloat(position, 2, 0)));
+			transform.xBasis *= getFloat(scale, 0, 1);
+			transform.yBasis *= getFloat(scale, 1, 1);
+			transform.zBasis *= getFloat(scale, 2, 1);
+
+			addProp(shape, material, transform);
+		}
+
+		if (m_materials.size() == 0)
+			addMaterial(0.6f, 0.6f, 0.6f);
+
+		return true;
+	}
+
+	bool writeTo(const File& file)
+	{
+		Array<StaticSceneFormat::Node> nodes;
+		Array<int> order;
+
+		for (int i = 0; i < m_props.size(); ++i)
+			order.add(i);
+
+		if (order.size() > 0)
+			buildNode(order.getRawDataPointer(), 0, order.size(), nodes, 0);
+
+		TemporaryFile temp(file);
+		ScopedPointer<FileOutputStream> stream(temp.getFile().createOutputStream());
+
+		if (stream == nullptr || stream->failedToOpen())
+			return false;
+
+		stream->writeInt(StaticSceneFormat::kMagic);
+		stream->writeInt(StaticSceneFormat::kVersion);
+		stream->writeInt(m_materials.size());
+		stream->writeInt(m_props.size());
+		stream->writeInt(nodes.size());
+
+		for (int i = 0; i < 3; ++i)
+			stream->writeInt(0);
+
+		stream->write(m_materials.getRawDataPointer(), sizeof(StaticSceneFormat::Material) * (size_t) m_materials.size());
+
+		for (int i = 0; i < order.size(); ++i)
+			stream->write(&m_props.getReference(order[i]), sizeof(StaticSceneFormat::Prop));
+
+		stream->write(nodes.getRawDataPointer(), sizeof(StaticSceneFormat::Node) * (size_t) nodes.size());
+
+		stream = nullptr;
+		return temp.overwriteTargetFileWithTemporary();
+	}
+
+	// The index file for a scene: JSON scenes are compiled next to the source the first
+	// time and again whenever the source is newer. Anything else is taken to be an index.
+	static File compile(const File& source)
+	{
+		if (!source.hasFileExtension("json"))
+			return source;
+
+		const File index(source.withFileExtension("vhsc"));
+
+		if (index.existsAsFile() && index.getLastModificationTime() >= source.getLastModificationTime())
+			return index;
+
+		StaticSceneBuilder builder;
+
+		if (!builder.loadJSON(source) || !builder.writeTo(index))
+			return File::nonexistent;
+
+		return index;
+	}
+
+private:
+	static float getFloat(const var& values, int index, float defaultValue)
+	{
+		return index < values.size() ? (float) (double) values[index] : defaultValue;
+	}
+
+	// Sorts the props of the node into leaf order and appends the node and its children.
+	void buildNode(int* order, int first, int count, Array<StaticSceneFormat::Node>& nodes, int depth)
+	{
+		const int nodeIndex = nodes.size();
+		nodes.add(StaticSceneFormat::Node());
+
+		StaticSceneFormat::Node node;
+		float centresMin[3], centresMax[3];
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			node.boundsMin[axis] = centresMin[axis] = FLT_MAX;
+			node.boundsMax[axis] = centresMax[axis] = -FLT_MAX;
+		}
+
+		for (int i = first; i < first + count; ++i)
+		{
+			const StaticSceneFormat::Prop& prop = m_props.getReference(order[i]);
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				// Around the bounding spheres, so nodes never cull props their sphere would keep.
+				node.boundsMin[axis] = jmin(node.boundsMin[axis], prop.centre[axis] - prop.radius);
+				node.boundsMax[axis] = jmax(node.boundsMax[axis], prop.centre[axis] + prop.radius);
+				centresMin[axis] = jmin(centresMin[axis], prop.centre[axis]);
+				centresMax[axis] = jmax(centresMax[axis], prop.centre[axis]);
+			}
+		}
+
+		if (count <= StaticSceneFormat::kMaxLeafProps || depth + 1 >= StaticSceneFormat::kMaxDepth)
+		{
+			node.first = first;
+			node.numProps = count;
+			nodes.set(nodeIndex, node);
+			return;
+		}
+
+		int axis = 0;
+
+		for (int i = 1; i < 3; ++i)
+			if (centresMax[i] - centresMin[i] > centresMax[axis] - centresMin[axis])
+				axis = i;
+
+		const int half = count / 2;
+
+		std::nth_element(order + first, order + first + half, order + first + count, PropCentreLess(m_props, axis));
+
+		buildNode(order, first, half, nodes, depth + 1);
+
+		node.first = nodes.size();
+		node.numProps = 0;
+		nodes.set(nodeIndex, node);
+
+		buildNode(order, first + half, count - half, nodes, depth + 1);
+	}
+
+	struct PropCentreLess
+	{
+		PropCentreLess(const Array<StaticSceneFormat::Prop>& props, int axis) : m_props(props), m_axis(axis) {}
+
+		bool operator()(int a, int b) const
+		{
+			return m_props.getReference(a).centre[m_axis] < m_props.getReference(b).centre[m_axis];
+		}
+
+		const Array<StaticSceneFormat::Prop>& m_props;
+		int m_axis;
+	};
+
+	Array<StaticSceneFormat::Material> m_materials;
+	Array<StaticSceneFormat::Prop>     m_props;
+};
+
+#endif // VIRTUALHANDS_STATICSCENE_H
@@ -0,0 +1,432 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_STATICSCENERENDERER_H
+#define VIRTUALHANDS_STATICSCENERENDERER_H
+
+#include "GL/glew.h"
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LeapUtilGL.h"
+#include "DrawList.h"
+#include "StaticScene.h"
+#include "TraceEvents.h"
+
+//==============================================================================
+// Draws the props of a StaticScene that a view can see.
+//
+// The visible props are sorted by material and shape with a counting sort, and each
+// material and shape pair is drawn with one instanced call: the model matrices of a
+// view go into one streamed buffer and the shader takes them as per instance
+// attributes. Without instancing (before GL 3.3 or ARB_instanced_arrays) the same
+// sorted order is drawn one prop at a time.
+class StaticSceneRenderer
+{
+public:
+	StaticSceneRenderer()
+		: m_program(0),
+		m_meshBuffer(0),
+		m_instanceBuffer(0),
+		m_instanceCapacity(0),
+		m_colourUniform(-1)
+	{
+		for (int i = 0; i < StaticSceneFormat::kNumShapes; ++i)
+		{
+			m_meshFirst[i] = 0;
+			m_meshCount[i] = 0;
+		}
+	}
+
+	bool isInstanced() const  { return m_program != 0; }
+
+	bool initGL()
+	{
+		if (glDrawArraysInstanced == nullptr)
+		{
+			glewExperimental = GL_TRUE;
+			glewInit();
+		}
+
+		if (glDrawArraysInstanced == nullptr || glVertexAttribDivisor == nullptr || glCreateProgram == nullptr)
+		{
+			Logger::writeToLog("No instanced drawing (GL 3.3 or ARB_instanced_arrays), props are drawn one by one");
+			return false;
+		}
+
+		m_program = createProgram();
+
+		if (m_program == 0)
+			return false;
+
+		Array<float> vertices;
+		m_meshFirst[StaticSceneFormat::kShape_Box] = 0;
+		addBox(vertices);
+		m_meshCount[StaticSceneFormat::kShape_Box] = vertices.size() / kFloatsPerVertex;
+
+		m_meshFirst[StaticSceneFormat::kShape_Sphere] = vertices.size() / kFloatsPerVertex;
+		addSphere(vertices);
+		m_meshCount[StaticSceneFormat::kShape_Sphere] = vertices.size() / kFloatsPerVertex - m_meshFirst[StaticSceneFormat::kShape_Sphere];
+
+		glGenBuffers(1, &m_meshBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, m_meshBuffer);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.getRawDataPointer(), GL_STATIC_DRAW);
+
+		glGenBuffers(1, &m_instanceBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		m_instanceCapacity = 0;
+		return true;
+	}
+
+	void releaseGL()
+	{
+		if (m_meshBuffer != 0)
+			glDeleteBuffers(1, &m_meshBuffer);
+
+		if (m_instanceBuffer != 0)
+			glDeleteBuffers(1, &m_instanceBuffer);
+
+		if (m_program != 0)
+			glDeleteProgram(m_program);
+
+		m_meshBuffer = 0;
+		m_instanceBuffer = 0;
+		m_instanceCapacity = 0;
+		m_program = 0;
+	}
+
+	// Draws every prop the frustum can see, for the current view.
+	void draw(const StaticScene& scene, const ViewFrustum& frustum)
+	{
+		TRACE_SCOPE("drawStaticScene");
+
+		{
+			TRACE_SCOPE("cullStaticScene");
+			scene.findVisible(frustum, m_visible);
+		}
+
+		if (m_visible.size() == 0)
+			return;
+
+		sortByBatch(scene);
+
+		if (isInstanced())
+			drawInstanced(scene);
+		else
+			drawImmediate(scene);
+	}
+
+private:
+	enum
+	{
+		kFloatsPerVertex     = 6,   // position, normal
+		kFloatsPerInstance   = 16,
+		kPositionAttribute   = 0,
+		kNormalAttribute     = 1,
+		kTransformAttribute  = 2,   // four columns, 2 to 5
+		kSphereSlices        = 16,
+		kSphereStacks        = 12
+	};
+
+	// Visible props into m_sorted, grouped by material then shape; the props of batch
+	// b are m_sorted[m_batchStarts[b]] to m_sorted[m_batchStarts[b + 1] - 1].
+	void sortByBatch(const StaticScene& scene)
+	{
+		const int numBatches = scene.getNumMaterials() * StaticSceneFormat::kNumShapes;
+		m_batchStarts.clearQuick();
+		m_batchStarts.insertMultiple(0, 0, numBatches + 1);
+		int* starts = m_batchStarts.getRawDataPointer();
+
+		for (int i = 0; i < m_visible.size(); ++i)
+			++starts[getBatch(scene.getProp(m_visible.getUnchecked(i))) + 1];
+
+		for (int i = 0; i < numBatches; ++i)
+			starts[i + 1] += starts[i];
+
+		m_sorted.clearQuick();
+		m_sorted.insertMultiple(0, 0, m_visible.size());
+		m_cursors = m_batchStarts;
+
+		for (int i = 0; i < m_visible.size(); ++i)
+		{
+			const int prop = m_visible.getUnchecked(i);
+			m_sorted.set(m_cursors.getReference(getBatch(scene.getProp(prop)))++, prop);
+		}
+	}
+
+	// StaticScene only loads files whose materials and shapes are in range.
+	static int getBatch(const StaticSceneFormat::Prop& prop)
+	{
+		jassert(prop.shape >= 0 && prop.shape < StaticSceneFormat::kNumShapes);
+		return prop.material * StaticSceneFormat::kNumShapes + prop.shape;
+	}
+
+	void drawInstanced(const StaticScene& scene)
+	{
+		const int numInstances = m_sorted.size();
+		const GLsizeiptr size = (GLsizeiptr) numInstances * kFloatsPerInstance * sizeof(float);
+
+		if (m_instanceData.getData() == nullptr || numInstances > m_instanceCapacity)
+		{
+			m_instanceCapacity = jmax(numInstances, m_instanceCapacity * 2);
+			m_instanceData.realloc((size_t) m_instanceCapacity * kFloatsPerInstance);
+		}
+
+		for (int i = 0; i < numInstances; ++i)
+			memcpy(m_instanceData + i * kFloatsPerInstance, scene.getProp(m_sorted.getUnchecked(i)).transform,
+				kFloatsPerInstance * sizeof(float));
+
+		// Orphans last view's matrices rather than waiting for the draws reading them.
+		glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, m_instanceData);
+
+		glUseProgram(m_program);
+
+		for (int column = 0; column < 4; ++column)
+		{
+			glEnableVertexAttribArray(kTransformAttribute + column);
+			glVertexAttribDivisor(kTransformAttribute + column, 1);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_meshBuffer);
+		glEnableVertexAttribArray(kPositionAttribute);
+		glEnableVertexAttribArray(kNormalAttribute);
+		glVertexAttribPointer(kPositionAttribute, 3, GL_FLOAT, GL_FALSE, kFloatsPerVertex * sizeof(float), (const GLvoid*) 0);
+		glVertexAttribPointer(kNormalAttribute, 3, GL_FLOAT, GL_FALSE, kFloatsPerVertex * sizeof(float), (const GLvoid*) (3 * sizeof(float)));
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+		int iMaterial = -1;
+
+		for (int batch = 0; batch + 1 < m_batchStarts.size(); ++batch)
+		{
+			const int first = m_batchStarts.getUnchecked(batch);
+			const int count = m_batchStarts.getUnchecked(batch + 1) - first;
+
+			if (count == 0)
+				continue;
+
+			const int material = batch / StaticSceneFormat::kNumShapes;
+			const int shape = batch % StaticSceneFormat::kNumShapes;
+
+			if (material != iMaterial)
+			{
+				glUniform4fv(m_colourUniform, 1, scene.getMaterial(material).colour);
+				iMaterial = material;
+			}
+
+			for (int column = 0; column < 4; ++column)
+				glVertexAttribPointer(kTransformAttribute + column, 4, GL_FLOAT, GL_FALSE, kFloatsPerInstance * sizeof(float),
+					(const GLvoid*) (((size_t) first * kFloatsPerInstance + column * 4) * sizeof(float)));
+
+			glDrawArraysInstanced(GL_TRIANGLES, m_meshFirst[shape], m_meshCount[shape], count);
+		}
+
+		for (int column = 0; column < 4; ++column)
+		{
+			glVertexAttribDivisor(kTransformAttribute + column, 0);
+			glDisableVertexAttribArray(kTransformAttribute + column);
+		}
+
+		glDisableVertexAttribArray(kNormalAttribute);
+		glDisableVertexAttribArray(kPositionAttribute);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glUseProgram(0);
+	}
+
+	void drawImmediate(const StaticScene& scene)
+	{
+		LeapUtilGL::GLAttribScope attribScope(GL_CURRENT_BIT | GL_ENABLE_BIT);
+		glDisable(GL_BLEND);
+
+		int iMaterial = -1;
+
+		for (int i = 0; i < m_sorted.size(); ++i)
+		{
+			const StaticSceneFormat::Prop& prop = scene.getProp(m_sorted.getUnchecked(i));
+
+			if (prop.material != iMaterial)
+			{
+				glColor4fv(scene.getMaterial(prop.material).colour);
+				iMaterial = prop.material;
+			}
+
+			glPushMatrix();
+			glMultMatrixf(prop.transform);
+
+			if (prop.shape == StaticSceneFormat::kShape_Sphere)
+				LeapUtilGL::drawSphere(LeapUtilGL::kStyle_Solid);
+			else
+				LeapUtilGL::drawBox(LeapUtilGL::kStyle_Solid);
+
+			glPopMatrix();
+		}
+	}
+
+	//==============================================================================
+	static void addVertex(Array<float>& vertices, const Leap::Vector& position, const Leap::Vector& normal)
+	{
+		vertices.add(position.x);
+		vertices.add(position.y);
+		vertices.add(position.z);
+		vertices.add(normal.x);
+		vertices.add(normal.y);
+		vertices.add(normal.z);
+	}
+
+	// Unit cube around the origin, two counter clockwise triangles a face.
+	static void addBox(Array<float>& vertices)
+	{
+		const Leap::Vector axes[3] = { Leap::Vector::xAxis(), Leap::Vector::yAxis(), Leap::Vector::zAxis() };
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (int sign = -1; sign <= 1; sign += 2)
+			{
+				const Leap::Vector normal = axes[axis] * (float) sign;
+				const Leap::Vector u = axes[(axis + 1) % 3] * (float) sign * 0.5f;
+				const Leap::Vector v = axes[(axis + 2) % 3] * 0.5f;
+				const Leap::Vector centre = normal * 0.5f;
+
+				const Leap::Vector corners[4] = { centre - u - v, centre + u - v, centre + u + v, centre - u + v };
+				const int order[6] = { 0, 1, 2, 0, 2, 3 };
+
+				for (int i = 0; i < 6; ++i)
+					addVertex(vertices, corners[order[i]], normal);
+			}
+		}
+	}
+
+	// Unit diameter sphere around the origin, like LeapUtilGL::drawSphere.
+	static void addSphere(Array<float>& vertices)
+	{
+		for (int stack = 0; stack < kSphereStacks; ++stack)
+		{
+			for (int slice = 0; slice < kSphereSlices; ++slice)
+			{
+				Leap::Vector quad[4];
+
+				for (int corner = 0; corner < 4; ++corner)
+				{
+					const float polar = LeapUtil::kfPi * (stack + (corner >> 1)) / kSphereStacks;
+					const float azimuth = LeapUtil::kfTwoPi * (slice + ((corner + (corner >> 1)) & 1)) / kSphereSlices;
+					quad[corner] = Leap::Vector(std::sin(polar) * std::cos(azimuth), std::cos(polar), -std::sin(polar) * std::sin(azimuth));
+				}
+
+				const int order[6] = { 0, 2, 1, 0, 3, 2 };
+
+				for (int i = 0; i < 6; ++i)
+					addVertex(vertices, quad[order[i]] * 0.5f, quad[order[i]]);
+			}
+		}
+	}
+
+	GLuint createProgram()
+	{
+		// One light from the upper left like LIGHT0, scaled normals are fine for shading.
+		static const char* vertexShader =
+			"#version 120\n"
+			"attribute vec3 position;\n"
+			"attribute vec3 normal;\n"
+			"attribute vec4 transform0;\n"
+			"attribute vec4 transform1;\n"
+			"attribute vec4 transform2;\n"
+			"attribute vec4 transform3;\n"
+			"uniform vec4 colour;\n"
+			"varying vec4 shaded;\n"
+			"void main()\n"
+			"{\n"
+			"    mat4 model = mat4(transform0, transform1, transform2, transform3);\n"
+			"    vec3 worldNormal = normalize(mat3(model) * normal);\n"
+			"    float diffuse = max(dot(worldNormal, normalize(vec3(-1.0, 1.0, -1.0))), 0.0);\n"
+			"    shaded = vec4(colour.rgb * (0.45 + 0.55 * diffuse), colour.a);\n"
+			"    gl_Position = gl_ModelViewProjectionMatrix * (model * vec4(position, 1.0));\n"
+			"}\n";
+
+		static const char* fragmentShader =
+			"#version 120\n"
+			"varying vec4 shaded;\n"
+			"void main()\n"
+			"{\n"
+			"    gl_FragColor = shaded;\n"
+			"}\n";
+
+		GLuint program = glCreateProgram();
+		const GLuint shaders[] = { compileShader(GL_VERTEX_SHADER, vertexShader),
+			compileShader(GL_FRAGMENT_SHADER, fragmentShader) };
+
+		for (int i = 0; i < numElementsInArray(shaders); ++i)
+		{
+			if (shaders[i] != 0)
+			{
+				glAttachShader(program, shaders[i]);
+				glDeleteShader(shaders[i]);
+			}
+		}
+
+		glBindAttribLocation(program, kPositionAttribute, "position");
+		glBindAttribLocation(program, kNormalAttribute, "normal");
+
+		for (int column = 0; column < 4; ++column)
+			glBindAttribLocation(program, kTransformAttribute + column, ("transform" + String(column)).toRawUTF8());
+
+		glLinkProgram(program);
+
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+		if (linked != GL_TRUE || shaders[0] == 0 || shaders[1] == 0)
+		{
+			char log[1024] = { 0 };
+			glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+			Logger::writeToLog("Could not link the static scene shader: " + String(log));
+
+			glDeleteProgram(program);
+			return 0;
+		}
+
+		m_colourUniform = glGetUniformLocation(program, "colour");
+		return program;
+	}
+
+	static GLuint compileShader(GLenum type, const char* source)
+	{
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, nullptr);
+		glCompileShader(shader);
+
+		GLint compiled = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+
+		if (compiled != GL_TRUE)
+		{
+			char log[1024] = { 0 };
+			glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+			Logger::writeToLog("Could not compile the static scene shader: " + String(log));
+
+			glDeleteShader(shader);
+			return 0;
+		}
+
+		return shader;
+	}
+
+	Array<int>      m_visible;
+	Array<int>      m_sorted;
+	Array<int>      m_batchStarts;
+	Array<int>      m_cursors;
+	HeapBlock<float> m_instanceData;
+
+	GLuint          m_program;
+	GLuint          m_meshBuffer;
+	GLuint          m_instanceBuffer;
+	int             m_instanceCapacity;
+	GLint           m_colourUniform;
+	GLint           m_meshFirst[StaticSceneFormat::kNumShapes];
+	GLsizei         m_meshCount[StaticSceneFormat::kNumShapes];
+};
+
+#endif // VIRTUALHANDS_STATICSCENERENDERER_H
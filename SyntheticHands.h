@@ -0,0 +1,110 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_SYNTHETICHANDS_H
+#define VIRTUALHANDS_SYNTHETICHANDS_H
+
+#include "HandSnapshot.h"
+
+//==============================================================================
+// Deterministic fake Leap frames, for running the hand processing without a device.
+// Hands sway over the area where the demo bodies rest, low enough for the
+// fingertips to reach them now and then. Units are Leap millimetres.
+class SyntheticHands
+{
+public:
+	SyntheticHands(int numHands, int64 seed)
+		: m_numHands(jlimit(0, (int) FrameSnapshot::kMaxHands, numHands)),
+		m_random(seed),
+		m_frameId(0)
+	{
+		for (int handCount = 0; handCount < m_numHands; ++handCount)
+		{
+			HandMotion& motion = m_motions[handCount];
+			motion.centre = Leap::Vector(-150.0f + 300.0f * (handCount + 0.5f) / m_numHands, 150.0f, -150.0f);
+			motion.phase = m_random.nextFloat() * 6.2831853f;
+			motion.speed = 0.5f + m_random.nextFloat();
+
+			for (int fingerCount = 0; fingerCount < HandSnapshot::kMaxFingers; ++fingerCount)
+				motion.fingerLengths[fingerCount] = 40.0f + m_random.nextFloat() * 30.0f;
+		}
+	}
+
+	// Frames are 1/100 s apart, roughly the rate of the device.
+	void nextFrame(FrameSnapshot& frame)
+	{
+		const float t = m_frameId * 0.01f;
+
+		frame.id = ++m_frameId;
+		frame.timestamp = m_frameId * 10000;
+		frame.numHands = m_numHands;
+
+		for (int handCount = 0; handCount < m_numHands; ++handCount)
+		{
+			const HandMotion& motion = m_motions[handCount];
+			HandSnapshot& hand = frame.hands[handCount];
+			const float angle = motion.phase + t * motion.speed;
+
+			hand.id = handCount + 1;
+			hand.sphereRadius = 80.0f;
+			hand.palmPosition = motion.centre + Leap::Vector(std::sin(angle) * 120.0f,
+				std::sin(angle * 1.7f) * 100.0f, std::cos(angle * 0.6f) * 120.0f);
+			hand.palmNormal = Leap::Vector(std::sin(angle) * 0.3f, -1.0f, 0.1f).normalized();
+			hand.direction = Leap::Vector(std::sin(angle * 0.5f) * 0.4f, 0.1f, -1.0f).normalized();
+			hand.numFingers = 1 + (int) ((angle * 10.0f) / 7.0f + handCount) % HandSnapshot::kMaxFingers;
+			hand.thumbId = hand.id * 10;
+
+			const Leap::Vector side = hand.direction.cross(hand.palmNormal).normalized();
+
+			for (int fingerCount = 0; fingerCount < hand.numFingers; ++fingerCount)
+			{
+				FingerSnapshot& finger = hand.fingers[fingerCount];
+				const float spread = (fingerCount - 2) * 0.25f;
+
+				finger.id = hand.id * 10 + fingerCount;
+				finger.length = motion.fingerLengths[fingerCount];
+				finger.direction = (hand.direction + side * spread + hand.palmNormal * 0.3f).normalized();
+				finger.tipPosition = hand.palmPosition + side * (spread * 60.0f) + finger.direction * (finger.length + 40.0f);
+				finger.stabilizedTipPosition = finger.tipPosition;
+				finger.tipVelocity = Leap::Vector(std::cos(angle) * 120.0f, std::cos(angle * 1.7f) * 170.0f,
+					-std::sin(angle * 0.6f) * 72.0f) * motion.speed;
+			}
+		}
+	}
+
+	static Array<FrameSnapshot> createFrames(int numHands, int numFrames, int64 seed)
+	{
+		SyntheticHands hands(numHands, seed);
+		Array<FrameSnapshot> frames;
+		frames.ensureStorageAllocated(numFrames);
+
+		for (int i = 0; i < numFrames; ++i)
+		{
+			FrameSnapshot frame;
+			hands.nextFrame(frame);
+			frames.add(frame);
+		}
+
+		return frames;
+	}
+
+private:
+	struct HandMotion
+	{
+		Leap::Vector centre;
+		float        phase;
+		float        speed;
+		float        fingerLengths[HandSnapshot::kMaxFingers];
+	};
+
+	int        m_numHands;
+	Random     m_random;
+	int64      m_frameId;
+	HandMotion m_motions[FrameSnapshot::kMaxHands];
+};
+
+#endif // VIRTUALHANDS_SYNTHETICHANDS_H
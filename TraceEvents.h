@@ -0,0 +1,240 @@
+/******************************************************************************\
+*  Aline Czarnobai															  *
+*  Virtual Hands - A Leap Motion Project, Fall 2013							  *
+*																			  *
+*  This project uses Leap Motion SDK, and JUCE toolkit						  *
+\******************************************************************************/
+
+#ifndef VIRTUALHANDS_TRACEEVENTS_H
+#define VIRTUALHANDS_TRACEEVENTS_H
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Scoped timing markers, written as Chrome trace event JSON (chrome://tracing or
+// ui.perfetto.dev). Every thread records into its own ring buffer, so recording
+// takes no lock; while tracing is off a scope costs one test of a global flag.
+//
+//     void update()
+//     {
+//         TRACE_SCOPE("update");
+//         ...
+//     }
+//
+// Names must be string literals, only the pointer is stored.
+class TraceRecorder
+{
+public:
+	static bool isEnabled()
+	{
+		return enabledFlag();
+	}
+
+	// Starts recording. Events from before this call are not written.
+	static void start(const File& output)
+	{
+		Registry& registry = getRegistry();
+
+		{
+			const ScopedLock sl(registry.lock);
+			registry.output = output;
+			registry.startTicks = Time::getHighResolutionTicks();
+		}
+
+		enabledFlag() = true;
+	}
+
+	// Stops recording and writes everything since start() to the file it was given.
+	static bool stop()
+	{
+		if (!enabledFlag())
+			return false;
+
+		enabledFlag() = false;
+
+		File output;
+		{
+			const ScopedLock sl(getRegistry().lock);
+			output = getRegistry().output;
+		}
+
+		const bool bWritten = writeJSON(output);
+
+		Logger::writeToLog(bWritten ? "Trace written to " + output.getFullPathName()
+			: "Could not write the trace to " + output.getFullPathName());
+
+		return bWritten;
+	}
+
+	// Where the T key writes traces when no file was given on the command line.
+	static File getDefaultFile()
+	{
+		return File::getSpecialLocation(File::userDocumentsDirectory)
+			.getNonexistentChildFile("VirtualHands-trace", ".json", false);
+	}
+
+	static void record(const char* name, int64 startTicks, int64 endTicks)
+	{
+		ThreadBuffer* pBuffer = getThreadBuffer();
+		const int64 index = pBuffer->writeIndex.value;   // only this thread writes it
+		Event& event = pBuffer->events[index & (kEventsPerThread - 1)];
+
+		event.name = name;
+		event.startTicks = startTicks;
+		event.endTicks = endTicks;
+
+		// Publishes the event; the writer thread is the only one that ever moves the index.
+		pBuffer->writeIndex.set(index + 1);
+	}
+
+	// Safe to call while other threads are still recording: events that get
+	// overwritten while they are being copied are dropped.
+	static bool writeJSON(const File& file)
+	{
+		Registry& registry = getRegistry();
+		const ScopedLock sl(registry.lock);
+
+		file.deleteFile();
+		FileOutputStream stream(file, 1 << 16);
+
+		if (stream.failedToOpen())
+			return false;
+
+		const double ticksToMicroseconds = 1000000.0 / (double) Time::getHighResolutionTicksPerSecond();
+		HeapBlock<Event> events(kEventsPerThread);
+		bool bFirst = true;
+
+		stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+		for (int threadIndex = 0; threadIndex < registry.buffers.size(); ++threadIndex)
+		{
+			const ThreadBuffer& buffer = *registry.buffers.getUnchecked(threadIndex);
+			const int tid = threadIndex + 1;
+
+			stream << (bFirst ? "\n" : ",\n")
+				<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+				<< ",\"args\":{\"name\":\"" << buffer.threadName << "\"}}";
+			bFirst = false;
+
+			const int64 endIndex = buffer.writeIndex.get();
+			const int64 beginIndex = jmax((int64) 0, endIndex - kEventsPerThread);
+
+			for (int64 i = beginIndex; i < endIndex; ++i)
+				events[(int) (i - beginIndex)] = buffer.events[i & (kEventsPerThread - 1)];
+
+			// Anything the writer may have lapped while we copied is unreliable.
+			const int64 firstValid = jmax(beginIndex, buffer.writeIndex.get() - kEventsPerThread);
+
+			for (int64 i = firstValid; i < endIndex; ++i)
+			{
+				const Event& event = events[(int) (i - beginIndex)];
+
+				if (event.startTicks < registry.startTicks)
+					continue;
+
+				stream << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+					<< ",\"ts\":" << String((event.startTicks - registry.startTicks) * ticksToMicroseconds, 3)
+					<< ",\"dur\":" << String((event.endTicks - event.startTicks) * ticksToMicroseconds, 3) << "}";
+			}
+		}
+
+		stream << "\n]}\n";
+		stream.flush();
+		return true;
+	}
+
+private:
+	enum { kEventsPerThread = 1 << 14 };   // must be a power of two
+
+	struct Event
+	{
+		const char* name;
+		int64       startTicks;
+		int64       endTicks;
+	};
+
+	struct ThreadBuffer
+	{
+		explicit ThreadBuffer(const String& name)
+			: threadName(name),
+			events(kEventsPerThread)
+		{}
+
+		String           threadName;
+		HeapBlock<Event> events;
+		Atomic<int64>    writeIndex;
+	};
+
+	struct Registry
+	{
+		Registry() : startTicks(0) {}
+
+		CriticalSection                 lock;
+		OwnedArray<ThreadBuffer>        buffers;   // kept after their thread ends, until the app quits
+		ThreadLocalValue<ThreadBuffer*> threadBuffer;
+		File                            output;
+		int64                           startTicks;
+	};
+
+	// Constant initialised, so reading it is a single load without a guard.
+	static volatile bool& enabledFlag()
+	{
+		static volatile bool s_bEnabled = false;
+
+		return s_bEnabled;
+	}
+
+	static Registry& getRegistry()
+	{
+		static Registry s_registry;
+
+		return s_registry;
+	}
+
+	static ThreadBuffer* getThreadBuffer()
+	{
+		Registry& registry = getRegistry();
+		ThreadBuffer*& pBuffer = registry.threadBuffer.get();
+
+		if (pBuffer == nullptr)
+		{
+			Thread* pThread = Thread::getCurrentThread();
+			const String name(pThread != nullptr ? pThread->getThreadName()
+				: MessageManager::existsAndIsCurrentThread() ? String("Message thread")
+				: "Thread " + String::toHexString((pointer_sized_int) Thread::getCurrentThreadId()));
+
+			const ScopedLock sl(registry.lock);
+			pBuffer = registry.buffers.add(new ThreadBuffer(name));
+		}
+
+		return pBuffer;
+	}
+};
+
+//==============================================================================
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name)
+		: m_name(TraceRecorder::isEnabled() ? name : nullptr),
+		m_startTicks(m_name != nullptr ? Time::getHighResolutionTicks() : 0)
+	{}
+
+	~TraceScope()
+	{
+		if (m_name != nullptr)
+			TraceRecorder::record(m_name, m_startTicks, Time::getHighResolutionTicks());
+	}
+
+private:
+	const char* m_name;
+	int64       m_startTicks;
+
+	JUCE_DECLARE_NON_COPYABLE (TraceScope)
+};
+
+#define TRACE_SCOPE_CONCAT2(a, b) a##b
+#define TRACE_SCOPE_CONCAT(a, b) TRACE_SCOPE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) const TraceScope TRACE_SCOPE_CONCAT(traceScope_, __LINE__)(name)
+
+#endif // VIRTUALHANDS_TRACEEVENTS_H